@@ -0,0 +1,54 @@
+
+#include "BinaryFormat.h"
+
+namespace elastos {
+
+void BinaryWriter::Reset()
+{
+    mBuffer.clear();
+}
+
+BinaryWriter& BinaryWriter::Header(BinaryCommand command)
+{
+    Byte(BINARY_MAGIC);
+    Byte(BINARY_VERSION);
+    return Byte(command);
+}
+
+BinaryWriter& BinaryWriter::Byte(uint8_t value)
+{
+    mBuffer.push_back(static_cast<char>(value));
+    return *this;
+}
+
+BinaryWriter& BinaryWriter::Varint(uint64_t value)
+{
+    while (value >= 0x80) {
+        mBuffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    mBuffer.push_back(static_cast<char>(value));
+    return *this;
+}
+
+BinaryWriter& BinaryWriter::SignedVarint(int64_t value)
+{
+    uint64_t zigzag = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    return Varint(zigzag);
+}
+
+BinaryWriter& BinaryWriter::Bytes(const char* data, size_t length)
+{
+    Varint(length);
+    mBuffer.append(data, length);
+    return *this;
+}
+
+std::string BinaryWriter::Detach()
+{
+    std::string frame;
+    frame.swap(mBuffer);
+    return frame;
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef __ELASTOS_BINARY_FORMAT_H__
+#define __ELASTOS_BINARY_FORMAT_H__
+
+#include <string>
+#include <cstdint>
+
+// Compact encoding friends may opt into with the setFormat command.
+// A frame starts with BINARY_MAGIC, which can never start a json text,
+// then BINARY_VERSION and a BinaryCommand byte:
+//   pushData     list, more byte
+//   getData      moment
+//   getDataList  list
+//   getDataPage  direction byte (0 older, 1 newer), list, more byte
+// A list is a sequence of items closed by a 0 byte. Items start with 1
+// (id/time entry) or 2 (moment); ids and times are zigzag varint deltas
+// from the previous item, text is a varint length followed by the bytes:
+//   entry   1, id, time
+//   moment  2, id, type (varint), time, content, files, access
+// Frames are sent as binary messages, never through the text path.
+#define BINARY_MAGIC    0xB1
+#define BINARY_VERSION  1
+
+namespace elastos {
+
+enum class WireFormat {
+    Json = 0,
+    Binary = 1
+};
+
+enum BinaryCommand {
+    BINARY_PUSH_DATA = 1,
+    BINARY_GET_DATA,
+    BINARY_GET_DATA_LIST,
+    BINARY_GET_DATA_PAGE
+};
+
+class BinaryWriter
+{
+public:
+    BinaryWriter() = default;
+    ~BinaryWriter() = default;
+
+    // empties the buffer but keeps its capacity
+    void Reset();
+
+    BinaryWriter& Header(BinaryCommand command);
+
+    BinaryWriter& Byte(uint8_t value);
+    BinaryWriter& Varint(uint64_t value);
+    BinaryWriter& SignedVarint(int64_t value);
+    BinaryWriter& Bytes(const char* data, size_t length);
+
+    const std::string& str() const { return mBuffer; }
+
+    // moves the frame out, leaving the writer empty
+    std::string Detach();
+
+private:
+    std::string mBuffer;
+};
+
+}
+
+#endif //__ELASTOS_BINARY_FORMAT_H__
@@ -0,0 +1,119 @@
+
+#include "CursorStore.h"
+#include "Log.h"
+
+namespace elastos {
+
+CursorStore::CursorStore(const std::shared_ptr<DatabaseCache::Handle>& database)
+    : mDatabase(database)
+    , mLoaded(false)
+{
+}
+
+int CursorStore::Get(const std::string& friendCode, DatabaseHelper::Cursor& cursor, bool* found)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    *found = false;
+    int ret = Load();
+    if (ret != 0) {
+        return ret;
+    }
+
+    auto it = mCursors.find(friendCode);
+    if (it != mCursors.end()) {
+        cursor = it->second;
+        *found = true;
+    }
+
+    return 0;
+}
+
+int CursorStore::Set(const std::string& friendCode, const DatabaseHelper::Cursor& cursor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    int ret = Load();
+    if (ret != 0) {
+        return ret;
+    }
+
+    mCursors[friendCode] = cursor;
+    mDirty.insert(friendCode);
+    return 0;
+}
+
+bool CursorStore::Advance(const std::string& friendCode, const DatabaseHelper::Cursor& from,
+                          const DatabaseHelper::Cursor& to)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (Load() != 0) {
+        return false;
+    }
+
+    auto it = mCursors.find(friendCode);
+    if (it == mCursors.end() || !(it->second == from)) {
+        return false;
+    }
+
+    it->second = to;
+    mDirty.insert(friendCode);
+    return true;
+}
+
+int CursorStore::Flush()
+{
+    std::vector<std::pair<std::string, DatabaseHelper::Cursor>> cursors;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mDirty.empty()) {
+            return 0;
+        }
+
+        cursors.reserve(mDirty.size());
+        for (const auto& friendCode : mDirty) {
+            cursors.emplace_back(friendCode, mCursors[friendCode]);
+        }
+        mDirty.clear();
+    }
+
+    int ret = mDatabase->Get()->SaveCursors(cursors);
+    if (ret != 0) {
+        LOGE(LOG_PUSH, "CursorStore flush %zu cursors failed %d", cursors.size(), ret);
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (const auto& item : cursors) {
+            mDirty.insert(item.first);
+        }
+    }
+
+    return ret;
+}
+
+bool CursorStore::Unload()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mDirty.empty()) {
+        return false;
+    }
+
+    mCursors.clear();
+    mLoaded = false;
+    return true;
+}
+
+int CursorStore::Load()
+{
+    if (mLoaded) return 0;
+
+    int ret = mDatabase->Get()->LoadCursors(mCursors);
+    if (ret != 0) {
+        // an empty map would re-push old moments and Flush would then
+        // overwrite the stored cursors
+        LOGE(LOG_PUSH, "CursorStore load cursors failed %d", ret);
+        mCursors.clear();
+        return ret;
+    }
+
+    mLoaded = true;
+    return 0;
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef __ELASTOS_CURSOR_STORE_H__
+#define __ELASTOS_CURSOR_STORE_H__
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "DatabaseHelper.h"
+#include "DatabaseCache.h"
+
+namespace elastos {
+
+// Per-friend delivery cursors kept in memory and written back to the
+// database in batches by Flush. They are loaded on first use.
+class CursorStore
+{
+public:
+    CursorStore(const std::shared_ptr<DatabaseCache::Handle>& database);
+    ~CursorStore() = default;
+
+    // found tells whether the friend has a cursor. The load error is
+    // returned when the cursors could not be read, nothing is known then
+    // and the next call tries again.
+    int Get(const std::string& friendCode, DatabaseHelper::Cursor& cursor, bool* found);
+
+    int Set(const std::string& friendCode, const DatabaseHelper::Cursor& cursor);
+
+    // moves the cursor to to only if it is still at from, so a failed
+    // delivery is never skipped by a later one that succeeded
+    bool Advance(const std::string& friendCode, const DatabaseHelper::Cursor& from,
+                 const DatabaseHelper::Cursor& to);
+
+    int Flush();
+
+    // drops the cursors from memory, false when some are not flushed
+    bool Unload();
+
+private:
+    // mMutex held, stays unloaded on error
+    int Load();
+
+private:
+    std::shared_ptr<DatabaseCache::Handle> mDatabase;
+
+    std::mutex mMutex;
+    std::unordered_map<std::string, DatabaseHelper::Cursor> mCursors;
+    std::unordered_set<std::string> mDirty;
+    bool mLoaded;
+};
+
+}
+
+#endif //__ELASTOS_CURSOR_STORE_H__
@@ -0,0 +1,137 @@
+
+#include "DatabaseCache.h"
+#include "Log.h"
+#include <vector>
+#include <algorithm>
+
+namespace elastos {
+
+DatabaseCache::Handle::Handle(DatabaseCache* cache, const std::string& path,
+                              const DatabaseHelper::StorageProfile& profile,
+                              const std::shared_ptr<Metrics>& metrics)
+    : mCache(cache)
+    , mPath(path)
+    , mProfile(profile)
+    , mMetrics(metrics)
+{
+}
+
+DatabaseCache::Handle::~Handle()
+{
+    mCache->Remove(this, true);
+}
+
+std::shared_ptr<DatabaseHelper> DatabaseCache::Handle::Get()
+{
+    auto helper = mCache->Find(this);
+    if (helper.get() != nullptr) {
+        return helper;
+    }
+
+    // opened outside the cache lock, other tenants are not held up
+    std::lock_guard<std::mutex> lock(mOpenMutex);
+    helper = mCache->Find(this);
+    if (helper.get() == nullptr) {
+        LOGD(LOG_DATABASE, "DatabaseCache open %s", mPath.c_str());
+        helper = std::make_shared<DatabaseHelper>(mPath, mProfile, mMetrics);
+        mCache->Insert(this, helper);
+    }
+
+    return helper;
+}
+
+bool DatabaseCache::Handle::Release()
+{
+    return mCache->Remove(this, false);
+}
+
+DatabaseCache::DatabaseCache(size_t max)
+    : mMax(std::max<size_t>(max, 1))
+{
+}
+
+std::shared_ptr<DatabaseCache::Handle> DatabaseCache::Open(const std::string& path,
+                                                           const DatabaseHelper::StorageProfile& profile,
+                                                           const std::shared_ptr<Metrics>& metrics)
+{
+    return std::shared_ptr<Handle>(new Handle(this, path, profile, metrics));
+}
+
+void DatabaseCache::SetMax(size_t max)
+{
+    std::vector<std::shared_ptr<DatabaseHelper>> closed;
+    std::unique_lock<std::mutex> lk(mMutex);
+    mMax = std::max<size_t>(max, 1);
+    Trim(closed);
+    lk.unlock();
+}
+
+size_t DatabaseCache::Size()
+{
+    std::unique_lock<std::mutex> lk(mMutex);
+    return mEntries.size();
+}
+
+std::shared_ptr<DatabaseHelper> DatabaseCache::Find(Handle* handle)
+{
+    std::unique_lock<std::mutex> lk(mMutex);
+    auto it = mIndex.find(handle);
+    if (it == mIndex.end()) {
+        return nullptr;
+    }
+
+    mEntries.splice(mEntries.begin(), mEntries, it->second);
+    return it->second->mHelper;
+}
+
+void DatabaseCache::Insert(Handle* handle, const std::shared_ptr<DatabaseHelper>& helper)
+{
+    std::vector<std::shared_ptr<DatabaseHelper>> closed;
+    std::unique_lock<std::mutex> lk(mMutex);
+    Entry entry;
+    entry.mHandle = handle;
+    entry.mHelper = helper;
+    mEntries.push_front(entry);
+    mIndex[handle] = mEntries.begin();
+    Trim(closed);
+    lk.unlock();
+}
+
+bool DatabaseCache::Remove(Handle* handle, bool force)
+{
+    std::shared_ptr<DatabaseHelper> helper;
+    std::unique_lock<std::mutex> lk(mMutex);
+    auto it = mIndex.find(handle);
+    if (it == mIndex.end()) {
+        return true;
+    }
+
+    // as in Trim, only the cache hands it out
+    if (!force && it->second->mHelper.use_count() > 1) {
+        return false;
+    }
+
+    helper = std::move(it->second->mHelper);
+    mEntries.erase(it->second);
+    mIndex.erase(it);
+    lk.unlock();
+
+    return true;
+}
+
+void DatabaseCache::Trim(std::vector<std::shared_ptr<DatabaseHelper>>& closed)
+{
+    auto it = mEntries.end();
+    while (mEntries.size() > mMax && it != mEntries.begin()) {
+        it--;
+        // only the cache holds it, and only the cache hands it out
+        if (it->mHelper.use_count() > 1) continue;
+
+        LOGD(LOG_DATABASE, "DatabaseCache close %s", it->mHandle->mPath.c_str());
+        closed.push_back(std::move(it->mHelper));
+        mIndex.erase(it->mHandle);
+        it = mEntries.erase(it);
+    }
+}
+
+}
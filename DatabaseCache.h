@@ -0,0 +1,90 @@
+#ifndef __ELASTOS_DATABASE_CACHE_H__
+#define __ELASTOS_DATABASE_CACHE_H__
+
+#include <string>
+#include <memory>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include "DatabaseHelper.h"
+#include "Metrics.h"
+
+// open databases kept by a host before idle ones are closed
+#define HOST_DATABASES_MAX      64
+
+namespace elastos {
+
+// Bounded set of open DatabaseHelper shared by the tenants of a host. A
+// database is opened on first use and the least recently used one that
+// nobody holds is closed once more than max are open.
+class DatabaseCache
+{
+public:
+    // the database of one tenant, it is only open while in the cache
+    class Handle
+    {
+    public:
+        ~Handle();
+
+        // opens the database when it is not open, hold the result only for
+        // the duration of a request so it can be closed in between
+        std::shared_ptr<DatabaseHelper> Get();
+
+        // closes the database, false while a request still holds it, it
+        // stays open then so no second DatabaseHelper is opened next to it
+        bool Release();
+
+    private:
+        Handle(DatabaseCache* cache, const std::string& path,
+               const DatabaseHelper::StorageProfile& profile, const std::shared_ptr<Metrics>& metrics);
+
+        DatabaseCache* mCache;
+        std::string mPath;
+        DatabaseHelper::StorageProfile mProfile;
+        std::shared_ptr<Metrics> mMetrics;
+
+        // one open at a time per database
+        std::mutex mOpenMutex;
+
+        friend class DatabaseCache;
+    };
+
+    DatabaseCache(size_t max = HOST_DATABASES_MAX);
+    ~DatabaseCache() = default;
+
+    // registers a database without opening it
+    std::shared_ptr<Handle> Open(const std::string& path, const DatabaseHelper::StorageProfile& profile,
+                                 const std::shared_ptr<Metrics>& metrics);
+
+    void SetMax(size_t max);
+
+    // open databases
+    size_t Size();
+
+private:
+    struct Entry {
+        Handle* mHandle;
+        std::shared_ptr<DatabaseHelper> mHelper;
+    };
+
+    std::shared_ptr<DatabaseHelper> Find(Handle* handle);
+    void Insert(Handle* handle, const std::shared_ptr<DatabaseHelper>& helper);
+    // force closes it with the last reference, otherwise it is only taken
+    // out of the cache when nobody else holds it
+    bool Remove(Handle* handle, bool force);
+
+    // mMutex held, moves the databases to close into closed
+    void Trim(std::vector<std::shared_ptr<DatabaseHelper>>& closed);
+
+private:
+    std::mutex mMutex;
+    size_t mMax;
+    // most recently used first
+    std::list<Entry> mEntries;
+    std::unordered_map<Handle*, std::list<Entry>::iterator> mIndex;
+};
+
+}
+
+#endif //__ELASTOS_DATABASE_CACHE_H__
@@ -1,11 +1,23 @@
 
 #include "DatabaseHelper.h"
+#include "TimelineCache.h"
+#include "Log.h"
 #include <sstream>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 
 
 #define DATABASE_FILE   "moments.db"
 #define SETTING_TABLE   "moments_setting"
 #define LIST_TABLE     "moments_list"
+#define LIST_INDEX     "moments_list_time_index"
+#define CURSOR_TABLE   "moments_cursor"
+
+// PRAGMA user_version of a database with every table and index below,
+// bump it when the schema changes
+#define SCHEMA_VERSION  1
 
 namespace elastos {
 
@@ -18,6 +30,70 @@ static int turn(int a)
     return ret;
 }
 
+const char* const DatabaseHelper::sStatementSql[STMT_COUNT] = {
+    // STMT_SET_SETTING
+    "INSERT OR REPLACE INTO " SETTING_TABLE "(id,name,value) VALUES "
+    "((SELECT id FROM " SETTING_TABLE " WHERE name=?1),?1,?2);",
+    // STMT_GET_SETTING
+    "SELECT value FROM " SETTING_TABLE " WHERE name=?;",
+    // STMT_INSERT_DATA
+    "INSERT INTO " LIST_TABLE "(type,content,time,files,access,isDelete) VALUES (?,?,?,?,?,0);",
+    // STMT_REMOVE_DATA
+    "UPDATE " LIST_TABLE " SET isDelete = 1 WHERE id=?;",
+    // STMT_CLEAR_DATA
+    "UPDATE " LIST_TABLE " SET isDelete = 1 WHERE isDelete = 0;",
+    // STMT_GET_ID_DELTA
+    "SELECT id, time FROM " LIST_TABLE
+    " WHERE isDelete = 0 AND time>=?1 AND (time>?1 OR id>?2) ORDER BY time ASC, id ASC LIMIT ?3;",
+    // STMT_GET_DATA_LIST
+    "SELECT id, type, content, time, files, access FROM " LIST_TABLE
+    " WHERE isDelete = 0 AND time>? ORDER BY time DESC LIMIT ?;",
+    // STMT_GET_DATA
+    "SELECT id, type, content, time, files, access FROM " LIST_TABLE
+    " WHERE isDelete = 0 AND id=?;",
+    // STMT_GET_PAGE_OLDER
+    "SELECT id, type, content, time, files, access FROM " LIST_TABLE
+    " WHERE isDelete = 0 AND time<=?1 AND (time<?1 OR id<?2) ORDER BY time DESC, id DESC LIMIT ?3;",
+    // STMT_GET_PAGE_NEWER, the page right after the cursor returned newest first
+    "SELECT id, type, content, time, files, access FROM (SELECT * FROM " LIST_TABLE
+    " WHERE isDelete = 0 AND time>=?1 AND (time>?1 OR id>?2) ORDER BY time ASC, id ASC LIMIT ?3)"
+    " ORDER BY time DESC, id DESC;",
+    // STMT_HAS_NEWER
+    "SELECT EXISTS (SELECT 1 FROM " LIST_TABLE " WHERE isDelete = 0 AND time>=?1 AND (time>?1 OR id>?2));",
+    // STMT_SET_CURSOR
+    "INSERT OR REPLACE INTO " CURSOR_TABLE "(friend,time,id) VALUES (?,?,?);",
+    // STMT_GET_CURSORS
+    "SELECT friend, time, id FROM " CURSOR_TABLE ";",
+};
+
+const char* const DatabaseHelper::sStatementNames[STMT_COUNT] = {
+    "set_setting",
+    "get_setting",
+    "insert_data",
+    "remove_data",
+    "clear_data",
+    "get_id_delta",
+    "get_data_list",
+    "get_data",
+    "get_page_older",
+    "get_page_newer",
+    "has_newer",
+    "set_cursor",
+    "get_cursors",
+};
+
+static const char* ColumnText(sqlite3_stmt* pStmt, int column)
+{
+    const char* text = (const char*)sqlite3_column_text(pStmt, column);
+    return text != nullptr ? text : "";
+}
+
+// a time cursor <= 0 means no cursor, match every record
+static sqlite3_int64 TimeCursor(long time)
+{
+    return time > 0 ? time : std::numeric_limits<sqlite3_int64>::min();
+}
+
 
 Json DatabaseHelper::Moment::toJson()
 {
@@ -32,6 +108,12 @@ Json DatabaseHelper::Moment::toJson()
     return json;
 }
 
+DatabaseHelper::MomentView DatabaseHelper::Moment::View() const
+{
+    return MomentView(mId, mType, mContent.data(), mContent.size(), mTime,
+                      mFiles.data(), mFiles.size(), mAccess.data(), mAccess.size());
+}
+
 std::string DatabaseHelper::Moment::toString()
 {
     Json json = toJson();
@@ -40,64 +122,333 @@ std::string DatabaseHelper::Moment::toString()
 }
 
 
-DatabaseHelper::DatabaseHelper(const std::string& path)
+DatabaseHelper::StorageProfile DatabaseHelper::StorageProfile::FromName(const std::string& name)
+{
+    StorageProfile profile;
+    if (!name.compare("flash")) {
+        profile.mCacheSize = -16384;
+        profile.mMmapSize = 64 * 1024 * 1024;
+    }
+    else if (!name.compare("safe")) {
+        profile.mSynchronous = "FULL";
+    }
+    else if (!name.empty() && name.compare("default")) {
+        LOGW(LOG_DATABASE, "unknown storage profile %s, use default", name.c_str());
+    }
+
+    return profile;
+}
+
+DatabaseHelper::Connection::Connection()
+    : mDb(nullptr)
+    , mStmts()
+{
+}
+
+DatabaseHelper::Connection::~Connection()
+{
+    Close();
+}
+
+int DatabaseHelper::Connection::Open(const std::string& file, int flags)
+{
+    int ret = sqlite3_open_v2(file.c_str(), &mDb, flags, NULL);
+    if (ret != SQLITE_OK) {
+        LOGE(LOG_DATABASE, "open database %s failed, error code: %d", file.c_str(), ret);
+        sqlite3_close(mDb);
+        mDb = nullptr;
+    }
+
+    return turn(ret);
+}
+
+void DatabaseHelper::Connection::Close()
+{
+    for (int i = 0; i < STMT_COUNT; i++) {
+        if (mStmts[i] != nullptr) {
+            sqlite3_finalize(mStmts[i]);
+            mStmts[i] = nullptr;
+        }
+    }
+
+    if (mDb != nullptr) {
+        sqlite3_close(mDb);
+        mDb = nullptr;
+    }
+}
+
+int DatabaseHelper::Connection::Prepare()
+{
+    for (int i = 0; i < STMT_COUNT; i++) {
+        if (mStmts[i] != nullptr) continue;
+
+        int ret = sqlite3_prepare_v2(mDb, sStatementSql[i], -1, &mStmts[i], NULL);
+        if (ret != SQLITE_OK) {
+            LOGE(LOG_DATABASE, "prepare statement %d failed ret %d, %s", i, ret, sqlite3_errmsg(mDb));
+            return turn(ret);
+        }
+    }
+
+    return 0;
+}
+
+sqlite3_stmt* DatabaseHelper::Connection::GetStatement(Statement index)
+{
+    sqlite3_stmt* pStmt = mStmts[index];
+    if (pStmt == nullptr) {
+        // tables may not exist at open time, prepare on first use
+        int ret = sqlite3_prepare_v2(mDb, sStatementSql[index], -1, &pStmt, NULL);
+        if (ret != SQLITE_OK) {
+            LOGE(LOG_DATABASE, "prepare statement %d failed ret %d, %s", index, ret, sqlite3_errmsg(mDb));
+            return nullptr;
+        }
+        mStmts[index] = pStmt;
+        return pStmt;
+    }
+
+    sqlite3_reset(pStmt);
+    sqlite3_clear_bindings(pStmt);
+    return pStmt;
+}
+
+DatabaseHelper::ReadLease::ReadLease(DatabaseHelper* helper)
+    : mHelper(helper)
+    , mConnection(nullptr)
+{
+    std::unique_lock<std::mutex> lk(mHelper->mReaderMutex);
+    if (mHelper->mReaders.empty()) {
+        lk.unlock();
+        mWriterLock = std::unique_lock<std::mutex>(mHelper->mWriterMutex);
+        mConnection = &mHelper->mWriter;
+        return;
+    }
+
+    mHelper->mReaderCv.wait(lk, [this] {
+        return !mHelper->mIdleReaders.empty();
+    });
+    mConnection = mHelper->mIdleReaders.back();
+    mHelper->mIdleReaders.pop_back();
+}
+
+DatabaseHelper::ReadLease::~ReadLease()
+{
+    if (mWriterLock.owns_lock()) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lk(mHelper->mReaderMutex);
+    mHelper->mIdleReaders.push_back(mConnection);
+    lk.unlock();
+    mHelper->mReaderCv.notify_one();
+}
+
+DatabaseHelper::DatabaseHelper(const std::string& path, const StorageProfile& profile,
+                               const std::shared_ptr<Metrics>& metrics)
+    : mTimeline(std::make_shared<TimelineCache>())
+    , mMetrics(metrics)
+    , mStatementTimes()
+    , mTimelineHits(nullptr)
+    , mTimelineMisses(nullptr)
 {
+    if (mMetrics != nullptr) {
+        for (int i = 0; i < STMT_COUNT; i++) {
+            mStatementTimes[i] = mMetrics->GetHistogram(std::string("sql.") + sStatementNames[i]);
+        }
+        mTimelineHits = mMetrics->GetCounter("timeline.hit");
+        mTimelineMisses = mMetrics->GetCounter("timeline.miss");
+    }
+
     std::stringstream ss;
     ss << path << "/" << DATABASE_FILE;
-    int ret = sqlite3_open(ss.str().c_str(), &mDb);
+    std::string file = ss.str();
+
+    int ret = mWriter.Open(file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX);
     if (ret != SQLITE_OK) {
-        printf("open database %s failed, error code: %d\n", ss.str().c_str(), ret);
         return;
     }
 
-    bool exist = TableExist(SETTING_TABLE);
-    if (!exist) {
-        CreateSettingTable();
+    ApplyProfile(mWriter, profile, true);
+
+    // a current database costs one pragma read instead of a probe per table
+    if (GetSchemaVersion() < SCHEMA_VERSION) {
+        CreateSchema();
     }
 
-    exist = TableExist(LIST_TABLE);
-    if (!exist) {
-        CreateDataTable();
+    mWriter.Prepare();
+
+    // readers only see the schema once it exists, open them last
+    for (int i = 0; i < profile.mReadConnections; i++) {
+        auto reader = std::make_shared<Connection>();
+        ret = reader->Open(file, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX);
+        if (ret != SQLITE_OK) {
+            break;
+        }
+
+        ApplyProfile(*reader, profile, false);
+        reader->Prepare();
+        mReaders.push_back(reader);
+        mIdleReaders.push_back(reader.get());
     }
+
+    LoadTimeline();
 }
 
 DatabaseHelper::~DatabaseHelper()
 {
-    sqlite3_close(mDb);
+    mReaders.clear();
+    mWriter.Close();
+}
+
+int DatabaseHelper::Execute(sqlite3_stmt* pStmt)
+{
+    int ret = sqlite3_step(pStmt);
+    if (ret != SQLITE_DONE) {
+        LOGE(LOG_DATABASE, "execute statement failed ret %d, %s", ret, sqlite3_errmsg(sqlite3_db_handle(pStmt)));
+        sqlite3_reset(pStmt);
+        return turn(ret);
+    }
+
+    sqlite3_reset(pStmt);
+    return 0;
+}
+
+std::shared_ptr<DatabaseHelper::Moment> DatabaseHelper::ReadMoment(sqlite3_stmt* pStmt)
+{
+    int id = sqlite3_column_int(pStmt, 0);
+    int type = sqlite3_column_int(pStmt, 1);
+    const char* content = ColumnText(pStmt, 2);
+    long recordTime = sqlite3_column_int64(pStmt, 3);
+    const char* files = ColumnText(pStmt, 4);
+    const char* access = ColumnText(pStmt, 5);
+
+    return std::make_shared<Moment>(id, type, content, recordTime, files, access);
+}
+
+DatabaseHelper::MomentView DatabaseHelper::ReadMomentView(sqlite3_stmt* pStmt)
+{
+    // sqlite3_column_bytes must follow sqlite3_column_text to get the text length
+    int id = sqlite3_column_int(pStmt, 0);
+    int type = sqlite3_column_int(pStmt, 1);
+    const char* content = ColumnText(pStmt, 2);
+    size_t contentLength = sqlite3_column_bytes(pStmt, 2);
+    long recordTime = sqlite3_column_int64(pStmt, 3);
+    const char* files = ColumnText(pStmt, 4);
+    size_t filesLength = sqlite3_column_bytes(pStmt, 4);
+    const char* access = ColumnText(pStmt, 5);
+    size_t accessLength = sqlite3_column_bytes(pStmt, 5);
+
+    return MomentView(id, type, content, contentLength, recordTime,
+                      files, filesLength, access, accessLength);
+}
+
+int DatabaseHelper::LoadTimeline()
+{
+    ReadLease reader(this);
+    sqlite3_stmt* pStmt = reader->GetStatement(STMT_GET_PAGE_OLDER);
+    if (pStmt == nullptr) {
+        LOGE(LOG_DATABASE, "Load timeline prepare failed");
+        return turn(SQLITE_ERROR);
+    }
+
+    int capacity = mTimeline->Capacity();
+    sqlite3_bind_int64(pStmt, 1, std::numeric_limits<sqlite3_int64>::max());
+    sqlite3_bind_int64(pStmt, 2, 0);
+    sqlite3_bind_int(pStmt, 3, capacity + 1);
+
+    std::vector<std::shared_ptr<Moment>> moments;
+    while (SQLITE_ROW == sqlite3_step(pStmt)) {
+        moments.push_back(ReadMoment(pStmt));
+    }
+    sqlite3_reset(pStmt);
+
+    bool complete = (int)moments.size() <= capacity;
+    mTimeline->Reset(moments, complete);
+    return 0;
 }
 
-bool DatabaseHelper::TableExist(const std::string& name)
+void DatabaseHelper::CountTimeline(bool hit)
 {
+    Counter* counter = hit ? mTimelineHits : mTimelineMisses;
+    if (counter != nullptr) {
+        counter->Add();
+    }
+}
+
+int DatabaseHelper::ApplyProfile(Connection& connection, const StorageProfile& profile, bool writer)
+{
+    sqlite3_busy_timeout(connection.mDb, profile.mBusyTimeout);
+
+    // journal mode is stored in the database file and only the writer may change it
     std::stringstream ss;
-    ss << "select count(*) from sqlite_master where type='table' and name='" << name << "'";
+    if (writer) {
+        ss << "PRAGMA journal_mode=" << profile.mJournalMode << ";";
+        ss << "PRAGMA synchronous=" << profile.mSynchronous << ";";
+    }
+    ss << "PRAGMA cache_size=" << profile.mCacheSize << ";";
+    ss << "PRAGMA mmap_size=" << profile.mMmapSize << ";";
+    ss << "PRAGMA temp_store=" << profile.mTempStore << ";";
 
-    sqlite3_stmt* pStmt = nullptr;
-    bool exist = false;
-    int count;
-    int ret = sqlite3_prepare_v2(mDb, ss.str().c_str(), -1, &pStmt, NULL);
+    char* errMsg;
+    int ret = sqlite3_exec(connection.mDb, ss.str().c_str(), NULL, NULL, &errMsg);
+    if (ret != SQLITE_OK) {
+        LOGE(LOG_DATABASE, "apply storage profile failed ret %d, %s", ret, errMsg);
+        sqlite3_free(errMsg);
+    }
+
+    return turn(ret);
+}
+
+int DatabaseHelper::GetSchemaVersion()
+{
+    sqlite3_stmt* pStmt;
+    int ret = sqlite3_prepare_v2(mWriter.mDb, "PRAGMA user_version;", -1, &pStmt, nullptr);
     if (ret != SQLITE_OK) {
-        goto exit;
+        return 0;
     }
 
-    ret = sqlite3_step(pStmt);
-    if (SQLITE_OK != ret && SQLITE_DONE != ret && SQLITE_ROW != ret) {
-        goto exit;
+    int version = 0;
+    if (sqlite3_step(pStmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(pStmt, 0);
     }
 
-    count = sqlite3_column_int(pStmt, 0);
-    exist = count > 0;
+    sqlite3_finalize(pStmt);
+    return version;
+}
+
+int DatabaseHelper::CreateSchema()
+{
+    // every step is idempotent, so databases from before the version
+    // existed are upgraded in place
+    char* errMsg;
+    int ret = sqlite3_exec(mWriter.mDb, "BEGIN;", NULL, NULL, &errMsg);
+    if (ret != SQLITE_OK) {
+        LOGE(LOG_DATABASE, "create schema begin transaction failed ret %d, %s", ret, errMsg);
+        sqlite3_free(errMsg);
+        return turn(ret);
+    }
 
-exit:
-    if (pStmt) {
-        sqlite3_finalize(pStmt);
+    ret = CreateSettingTable();
+    if (ret == 0) ret = CreateDataTable();
+    if (ret == 0) ret = CreateDataIndex();
+    if (ret == 0) ret = CreateCursorTable();
+    if (ret == 0) {
+        std::stringstream ss;
+        ss << "PRAGMA user_version = " << SCHEMA_VERSION << ";";
+        ret = CreateTable(ss.str());
     }
-    return exist;
+    if (ret != 0) {
+        sqlite3_exec(mWriter.mDb, "ROLLBACK;", NULL, NULL, NULL);
+        return ret;
+    }
+
+    ret = sqlite3_exec(mWriter.mDb, "COMMIT;", NULL, NULL, NULL);
+    return turn(ret);
 }
 
 int DatabaseHelper::CreateSettingTable()
 {
     std::stringstream ss;
-    ss << "CREATE TABLE " << SETTING_TABLE << "(id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, ";
+    ss << "CREATE TABLE IF NOT EXISTS " << SETTING_TABLE << "(id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, ";
     ss << "name TEXT UNIQUE NOT NULL, value TEXT NOT NULL);";
 
     return CreateTable(ss.str());
@@ -106,321 +457,461 @@ int DatabaseHelper::CreateSettingTable()
 int DatabaseHelper::CreateDataTable()
 {
     std::stringstream ss;
-    ss << "CREATE TABLE " << LIST_TABLE << "(id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, ";
+    ss << "CREATE TABLE IF NOT EXISTS " << LIST_TABLE << "(id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, ";
     ss << "type INTEGER NOT NULL, content TEXT NOT NULL, time INTEGER NOT NULL, files TEXT, access TEXT, isDelete INTEGER NOT NULL);";
 
     return CreateTable(ss.str());
 }
 
+int DatabaseHelper::CreateDataIndex()
+{
+    // the timeline queries seek and walk it in (time, id) order without a
+    // sort; the rowid (id) is stored in the index, so the id/time delta and
+    // has_newer are covered by it. Queries returning content still read the
+    // table for every row, the newer page also sorts its page once.
+    std::stringstream ss;
+    ss << "CREATE INDEX IF NOT EXISTS " << LIST_INDEX << " ON " << LIST_TABLE << "(isDelete, time);";
+
+    return CreateTable(ss.str());
+}
+
+int DatabaseHelper::CreateCursorTable()
+{
+    std::stringstream ss;
+    ss << "CREATE TABLE IF NOT EXISTS " << CURSOR_TABLE << "(friend TEXT PRIMARY KEY NOT NULL, ";
+    ss << "time INTEGER NOT NULL, id INTEGER NOT NULL);";
+
+    return CreateTable(ss.str());
+}
+
 int DatabaseHelper::CreateTable(const std::string& sql)
 {
     char* errMsg;
-    int ret = sqlite3_exec(mDb, sql.c_str(), NULL, NULL, &errMsg);
+    int ret = sqlite3_exec(mWriter.mDb, sql.c_str(), NULL, NULL, &errMsg);
     if (ret !=  SQLITE_OK) {
-        printf("create table failed ret %d, %s\n", ret, errMsg);
+        LOGE(LOG_DATABASE, "create table failed ret %d, %s", ret, errMsg);
         sqlite3_free(errMsg);
     }
 
     return turn(ret);
 }
 
-int DatabaseHelper::SetOwner(const std::string& owner)
+int DatabaseHelper::SetSetting(const std::string& name, const std::string& value)
 {
-    std::stringstream stream;
-    stream << "INSERT OR REPLACE INTO '" << SETTING_TABLE;
-    stream << "'(id,name,value) VALUES (";
-    stream << "(SELECT id FROM '" << SETTING_TABLE << "' WHERE name='owner'),'";
-    stream << "owner','" << owner << "');";
+    std::lock_guard<std::mutex> lock(mWriterMutex);
+    sqlite3_stmt* pStmt = mWriter.GetStatement(STMT_SET_SETTING);
+    if (pStmt == nullptr) {
+        return turn(SQLITE_ERROR);
+    }
+    ScopedTimer timer(mStatementTimes[STMT_SET_SETTING]);
+
+    sqlite3_bind_text(pStmt, 1, name.c_str(), name.size(), SQLITE_STATIC);
+    sqlite3_bind_text(pStmt, 2, value.c_str(), value.size(), SQLITE_STATIC);
 
-    return Insert(stream.str());
+    return Execute(pStmt);
 }
 
-std::string DatabaseHelper::GetOwner()
+std::string DatabaseHelper::GetSetting(const std::string& name)
 {
-    sqlite3_stmt* pStmt = nullptr;
-    std::stringstream ss;
-    ss << "SELECT * FROM '" << SETTING_TABLE << "' WHERE name='owner';";
-
-    std::string owner;
-    int ret = sqlite3_prepare_v2(mDb, ss.str().c_str(), -1, &pStmt, NULL);
-    if (ret != SQLITE_OK) {
-        goto exit;
+    ReadLease reader(this);
+    std::string value;
+    sqlite3_stmt* pStmt = reader->GetStatement(STMT_GET_SETTING);
+    if (pStmt == nullptr) {
+        return value;
     }
+    ScopedTimer timer(mStatementTimes[STMT_GET_SETTING]);
 
-    ret = sqlite3_step(pStmt);
-    if (ret != SQLITE_ROW) {
-        goto exit;
+    sqlite3_bind_text(pStmt, 1, name.c_str(), name.size(), SQLITE_STATIC);
+
+    if (sqlite3_step(pStmt) == SQLITE_ROW) {
+        value = ColumnText(pStmt, 0);
     }
 
-    owner = (char*)sqlite3_column_text(pStmt, 2);
+    sqlite3_reset(pStmt);
+    return value;
+}
 
-exit:
-    if (pStmt) {
-        sqlite3_finalize(pStmt);
-    }
-    return owner;
+int DatabaseHelper::SetOwner(const std::string& owner)
+{
+    return SetSetting("owner", owner);
 }
 
-int DatabaseHelper::SetPrivate(bool priv)
+std::string DatabaseHelper::GetOwner()
 {
-    std::stringstream stream;
-    stream << "INSERT OR REPLACE INTO '" << SETTING_TABLE;
-    stream << "'(id,name,value) VALUES (";
-    stream << "(SELECT id FROM '" << SETTING_TABLE << "' WHERE name='access'),'";
-    stream << "access','" << (priv ? "private" : "public") << "');";
+    return GetSetting("owner");
+}
 
-    return Insert(stream.str());
+int DatabaseHelper::SetPrivate(bool priv)
+{
+    return SetSetting("access", priv ? "private" : "public");
 }
 
 bool DatabaseHelper::GetPrivate()
 {
-    char sql[512];
-    sqlite3_stmt* pStmt = nullptr;
-    std::stringstream ss;
-    ss << "SELECT * FROM '" << SETTING_TABLE << "' WHERE name='access';";
-
-    char* priv;
-    bool isPrivate = false;
-    int ret = sqlite3_prepare_v2(mDb, ss.str().c_str(), -1, &pStmt, NULL);
-    if (ret != SQLITE_OK) {
-        goto exit;
-    }
-
-    ret = sqlite3_step(pStmt);
-    if (ret != SQLITE_ROW) {
-        goto exit;
-    }
-
-    priv = (char*)sqlite3_column_text(pStmt, 2);
-    if (!strcmp(priv, "private")) {
-        isPrivate = true;
-    }
-
-exit:
-    if (pStmt) {
-        sqlite3_finalize(pStmt);
-    }
-    return isPrivate;
+    std::string priv = GetSetting("access");
+    return !priv.compare("private");
 }
 
 int DatabaseHelper::InsertData(int type, const std::string& content,
             long time, const std::string& files, const std::string& access)
 {
-    std::stringstream stream;
-    stream << "INSERT INTO '" << LIST_TABLE;
-    stream << "'(type,content,time,files,access,isDelete) VALUES (";
-    stream << type << ",'" << content << "'," << time;
-    stream << ",'" << files << "','" << access << "',0);";
+    std::lock_guard<std::mutex> lock(mWriterMutex);
+    sqlite3_stmt* pStmt = mWriter.GetStatement(STMT_INSERT_DATA);
+    if (pStmt == nullptr) {
+        return turn(SQLITE_ERROR);
+    }
+    ScopedTimer timer(mStatementTimes[STMT_INSERT_DATA]);
 
-    int ret = Insert(stream.str());
+    sqlite3_bind_int(pStmt, 1, type);
+    sqlite3_bind_text(pStmt, 2, content.c_str(), content.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(pStmt, 3, time);
+    sqlite3_bind_text(pStmt, 4, files.c_str(), files.size(), SQLITE_STATIC);
+    sqlite3_bind_text(pStmt, 5, access.c_str(), access.size(), SQLITE_STATIC);
+
+    int ret = Execute(pStmt);
     if (ret != SQLITE_OK) {
         return ret;
     }
 
-    int id = sqlite3_last_insert_rowid(mDb);
+    int id = sqlite3_last_insert_rowid(mWriter.mDb);
+    mTimeline->Insert(std::make_shared<Moment>(id, type, content, time, files, access));
     return id;
 }
 
 int DatabaseHelper::RemoveData(int id)
 {
-    // char* errMsg;
-    // std::stringstream ss;
-    // ss << "DELETE FROM '" << LIST_TABLE << "' WHERE id=" << id << ";";
-
-    // int ret = sqlite3_exec(mDb, ss.str().c_str(), NULL, NULL, &errMsg);
-    // if (ret != SQLITE_OK) {
-    //     printf("remove data id %d failed ret %d, %s\n", id, ret, errMsg);
-    //     sqlite3_free(errMsg);
-    // }
-
-    // return turn(ret);
+    std::lock_guard<std::mutex> lock(mWriterMutex);
+    sqlite3_stmt* pStmt = mWriter.GetStatement(STMT_REMOVE_DATA);
+    if (pStmt == nullptr) {
+        return turn(SQLITE_ERROR);
+    }
+    ScopedTimer timer(mStatementTimes[STMT_REMOVE_DATA]);
 
-    char* errMsg;
-    std::stringstream ss;
-    ss << "UPDATE '" << LIST_TABLE << "' SET isDelete = 1 WHERE id=" << id << ";";
+    sqlite3_bind_int(pStmt, 1, id);
 
-    int ret = sqlite3_exec(mDb, ss.str().c_str(), NULL, NULL, &errMsg);
+    int ret = Execute(pStmt);
     if (ret != SQLITE_OK) {
-        printf("remove data id %d failed ret %d, %s\n", id, ret, errMsg);
-        sqlite3_free(errMsg);
+        LOGE(LOG_DATABASE, "remove data id %d failed ret %d", id, ret);
+    }
+    else {
+        mTimeline->Remove(id);
     }
 
-    return turn(ret);
+    return ret;
 }
 
 int DatabaseHelper::ClearData()
 {
-    // char* errMsg;
-    // std::stringstream ss;
-    // ss << "DELETE FROM '" << LIST_TABLE << "';";
+    std::lock_guard<std::mutex> lock(mWriterMutex);
+    sqlite3_stmt* pStmt = mWriter.GetStatement(STMT_CLEAR_DATA);
+    if (pStmt == nullptr) {
+        return turn(SQLITE_ERROR);
+    }
+    ScopedTimer timer(mStatementTimes[STMT_CLEAR_DATA]);
 
-    // int ret = sqlite3_exec(mDb, ss.str().c_str(), NULL, NULL, &errMsg);
-    // if (ret != SQLITE_OK) {
-    //     printf("clear data failed ret %d, %s\n", ret, errMsg);
-    //     sqlite3_free(errMsg);
-    //     return ret;
-    // }
+    int ret = Execute(pStmt);
+    if (ret != SQLITE_OK) {
+        LOGE(LOG_DATABASE, "clear data failed ret %d", ret);
+    }
+    else {
+        mTimeline->Clear();
+    }
 
-    // ret = sqlite3_exec(mDb, "VACUUM;", NULL, NULL, &errMsg);
-    // if (ret != SQLITE_OK) {
-    //     printf("clear unused space failed ret %d, %s\n", ret, errMsg);
-    //     sqlite3_free(errMsg);
-    // }
+    return ret;
+}
 
-    // return turn(ret);
+int DatabaseHelper::GetDelta(const Cursor& cursor, int limit, ResultWriter& writer,
+                             Cursor* last, bool* more)
+{
+    std::vector<std::shared_ptr<Moment>> moments;
+    bool hasMore = false;
+    Cursor lastCursor = cursor;
+
+    writer.BeginList();
+    if (mTimeline->GetDelta(cursor, limit, moments, &hasMore)) {
+        CountTimeline(true);
+        for (const auto& moment : moments) {
+            writer.WriteEntry(moment->GetId(), moment->GetTime());
+        }
+        if (!moments.empty()) {
+            lastCursor = Cursor(moments.back()->GetTime(), moments.back()->GetId());
+        }
+    }
+    else {
+        CountTimeline(false);
+        ReadLease reader(this);
+        sqlite3_stmt* pStmt = reader->GetStatement(STMT_GET_ID_DELTA);
+        if (pStmt == nullptr) {
+            LOGE(LOG_DATABASE, "Get delta prepare failed");
+            return turn(SQLITE_ERROR);
+        }
+        ScopedTimer timer(mStatementTimes[STMT_GET_ID_DELTA]);
+
+        // fetch one extra row to know whether the friend is caught up
+        sqlite3_bind_int64(pStmt, 1, TimeCursor(cursor.mTime));
+        sqlite3_bind_int64(pStmt, 2, cursor.mId);
+        sqlite3_bind_int(pStmt, 3, limit + 1);
+
+        int count = 0;
+        while(SQLITE_ROW == sqlite3_step(pStmt)) {
+            if (count == limit) {
+                hasMore = true;
+                break;
+            }
+            int id = sqlite3_column_int(pStmt, 0);
+            long recordTime = sqlite3_column_int64(pStmt, 1);
+
+            writer.WriteEntry(id, recordTime);
+
+            lastCursor = Cursor(recordTime, id);
+            count++;
+        }
 
-    char* errMsg;
-    std::stringstream ss;
-    ss << "UPDATE '" << LIST_TABLE << "' SET isDelete = 1;";
+        sqlite3_reset(pStmt);
+    }
+    writer.EndList();
 
-    int ret = sqlite3_exec(mDb, ss.str().c_str(), NULL, NULL, &errMsg);
-    if (ret != SQLITE_OK) {
-        printf("clear data failed ret %d, %s\n", ret, errMsg);
-        sqlite3_free(errMsg);
+    if (last != nullptr) {
+        *last = lastCursor;
+    }
+    if (more != nullptr) {
+        *more = hasMore;
     }
 
-    return turn(ret);
+    return 0;
 }
 
-int DatabaseHelper::Insert(const std::string& sql)
+int DatabaseHelper::GetData(long time, int limit, ResultWriter& writer, int* count)
 {
-    char* errMsg;
-    int ret = sqlite3_exec(mDb, "BEGIN;", NULL, NULL, &errMsg);
-    if (ret != SQLITE_OK) {
-        printf("insert begin transaction failed ret %d, %s\n", ret, errMsg);
-        sqlite3_free(errMsg);
-        return turn(ret);
+    std::vector<std::shared_ptr<Moment>> moments;
+    int written = 0;
+
+    writer.BeginList();
+    if (mTimeline->GetList(time, limit, moments)) {
+        CountTimeline(true);
+        for (const auto& moment : moments) {
+            writer.WriteMoment(moment->View());
+            written++;
+        }
     }
+    else {
+        CountTimeline(false);
+        ReadLease reader(this);
+        sqlite3_stmt* pStmt = reader->GetStatement(STMT_GET_DATA_LIST);
+        if (pStmt == nullptr) {
+            LOGE(LOG_DATABASE, "Get data prepare failed");
+            return turn(SQLITE_ERROR);
+        }
+        ScopedTimer timer(mStatementTimes[STMT_GET_DATA_LIST]);
 
-    printf("insert sql: %s\n", sql.c_str());
-    ret = sqlite3_exec(mDb, sql.c_str(), NULL, NULL, &errMsg);
-    if (ret != SQLITE_OK) {
-        printf("insert failed ret %d, %s\n", ret, errMsg);
-        sqlite3_free(errMsg);
-        sqlite3_exec(mDb, "ROLLBACK;", NULL, NULL, NULL);
-        return turn(ret);
+        sqlite3_bind_int64(pStmt, 1, TimeCursor(time));
+        sqlite3_bind_int(pStmt, 2, limit);
+
+        while (SQLITE_ROW == sqlite3_step(pStmt)) {
+            writer.WriteMoment(ReadMomentView(pStmt));
+            written++;
+        }
+
+        sqlite3_reset(pStmt);
     }
+    writer.EndList();
 
-    ret = sqlite3_exec(mDb, "COMMIT;", NULL, NULL, NULL);
-    return turn(ret);
+    if (count != nullptr) {
+        *count = written;
+    }
+
+    return 0;
 }
 
-int DatabaseHelper::GetData(long time, std::stringstream& data, long* lastTime)
+int DatabaseHelper::GetDataPage(long time, int id, PageDirection direction, int size,
+                                ResultWriter& writer, bool* more)
 {
-    sqlite3_stmt* pStmt = nullptr;
-    int ret = 0;
-    std::stringstream ss;
-    bool first = true;
-    ss << "SELECT id, time FROM '" << LIST_TABLE << "'";
-    ss << " WHERE isDelete != 1";
-    if (time > 0) {
-        ss << " AND time>" << time;
+    bool older = direction == PageDirection::Older;
+    std::vector<std::shared_ptr<Moment>> moments;
+    bool hasMore = false;
+
+    writer.BeginList();
+    if (mTimeline->GetPage(time, id, direction, size, moments, &hasMore)) {
+        CountTimeline(true);
+        for (const auto& moment : moments) {
+            writer.WriteMoment(moment->View());
+        }
     }
-    ss << " ORDER BY time DESC;";
+    else {
+        CountTimeline(false);
+        ReadLease reader(this);
+        sqlite3_stmt* pStmt = reader->GetStatement(older ? STMT_GET_PAGE_OLDER : STMT_GET_PAGE_NEWER);
+        if (pStmt == nullptr) {
+            LOGE(LOG_DATABASE, "Get data page prepare failed");
+            return turn(SQLITE_ERROR);
+        }
+        ScopedTimer timer(mStatementTimes[older ? STMT_GET_PAGE_OLDER : STMT_GET_PAGE_NEWER]);
+
+        sqlite3_int64 cursorTime = time;
+        sqlite3_int64 cursorId = id;
+        if (time <= 0) {
+            cursorTime = older ? std::numeric_limits<sqlite3_int64>::max()
+                               : std::numeric_limits<sqlite3_int64>::min();
+            cursorId = 0;
+        }
 
-    ret = sqlite3_prepare_v2(mDb, ss.str().c_str(), -1, &pStmt, NULL);
-    if (ret != SQLITE_OK) {
-        printf("Get data prepare failed ret:%d\n", ret);
-        goto exit;
+        // older pages fetch one extra row to know whether another page exists,
+        // newer pages come back newest first so that is checked afterwards
+        sqlite3_bind_int64(pStmt, 1, cursorTime);
+        sqlite3_bind_int64(pStmt, 2, cursorId);
+        sqlite3_bind_int(pStmt, 3, older ? size + 1 : size);
+
+        int count = 0;
+        Cursor newest;
+        while (SQLITE_ROW == sqlite3_step(pStmt)) {
+            if (count == size) {
+                hasMore = true;
+                break;
+            }
+
+            MomentView view = ReadMomentView(pStmt);
+            if (count == 0) {
+                newest = Cursor(view.mTime, view.mId);
+            }
+            writer.WriteMoment(view);
+            count++;
+        }
+        sqlite3_reset(pStmt);
+
+        if (!older && count == size) {
+            pStmt = reader->GetStatement(STMT_HAS_NEWER);
+            if (pStmt != nullptr) {
+                sqlite3_bind_int64(pStmt, 1, newest.mTime);
+                sqlite3_bind_int64(pStmt, 2, newest.mId);
+                if (SQLITE_ROW == sqlite3_step(pStmt)) {
+                    hasMore = sqlite3_column_int(pStmt, 0) != 0;
+                }
+                sqlite3_reset(pStmt);
+            }
+        }
     }
+    writer.EndList();
 
-    data << "[";
+    if (more != nullptr) {
+        *more = hasMore;
+    }
 
-    while(SQLITE_ROW == sqlite3_step(pStmt)) {
-        if (!first) {
-            data << ",";
-        }
-        data << "{";
-        int id = sqlite3_column_int(pStmt, 0);
-        data << "\"id\":" << id <<",";
-
-        long recordTime = sqlite3_column_int64(pStmt, 1);
-        data << "\"time\":" << recordTime <<"}";
-        if (first && lastTime != nullptr) {
-            *lastTime = recordTime;
+    return 0;
+}
+
+int DatabaseHelper::GetData(int id, ResultWriter& writer, bool* found)
+{
+    std::shared_ptr<DatabaseHelper::Moment> moment;
+    *found = false;
+    bool cached = mTimeline->Find(id, moment);
+    CountTimeline(cached);
+    if (cached) {
+        if (moment != nullptr) {
+            writer.WriteMoment(moment->View());
+            *found = true;
         }
-        first = false;
+        return 0;
+    }
+
+    ReadLease reader(this);
+    sqlite3_stmt* pStmt = reader->GetStatement(STMT_GET_DATA);
+    if (pStmt == nullptr) {
+        LOGE(LOG_DATABASE, "Get data prepare failed");
+        return turn(SQLITE_ERROR);
     }
+    ScopedTimer timer(mStatementTimes[STMT_GET_DATA]);
 
-    data << "]";
+    sqlite3_bind_int(pStmt, 1, id);
 
-exit:
-    if (pStmt) {
-        sqlite3_finalize(pStmt);
+    if (SQLITE_ROW == sqlite3_step(pStmt)) {
+        writer.WriteMoment(ReadMomentView(pStmt));
+        *found = true;
     }
-    return turn(ret);
+
+    sqlite3_reset(pStmt);
+    return 0;
 }
 
-int DatabaseHelper::GetData(long time, Json& json)
+int DatabaseHelper::LoadCursors(std::unordered_map<std::string, Cursor>& cursors)
 {
-    sqlite3_stmt* pStmt = nullptr;
-    int ret = 0, index = 0;
-    std::stringstream ss;
-    ss << "SELECT * FROM '" << LIST_TABLE << "'";
-    ss << " WHERE isDelete != 1";
-    if (time > 0) {
-        ss << " AND time>" << time;
+    ReadLease reader(this);
+    sqlite3_stmt* pStmt = reader->GetStatement(STMT_GET_CURSORS);
+    if (pStmt == nullptr) {
+        LOGE(LOG_DATABASE, "Load cursors prepare failed");
+        return turn(SQLITE_ERROR);
     }
-    ss << " ORDER BY time DESC LIMIT " << DATA_LIMIT << ";";
+    ScopedTimer timer(mStatementTimes[STMT_GET_CURSORS]);
 
-    ret = sqlite3_prepare_v2(mDb, ss.str().c_str(), -1, &pStmt, NULL);
-    if (ret != SQLITE_OK) {
-        printf("Get data prepare failed ret:%d\n", ret);
-        goto exit;
+    while (SQLITE_ROW == sqlite3_step(pStmt)) {
+        std::string friendCode = ColumnText(pStmt, 0);
+        long time = sqlite3_column_int64(pStmt, 1);
+        int id = sqlite3_column_int(pStmt, 2);
+        cursors[friendCode] = Cursor(time, id);
     }
 
-    while (SQLITE_ROW == sqlite3_step(pStmt)) {
-        int id = sqlite3_column_int(pStmt, 0);
-        int type = sqlite3_column_int(pStmt, 1);
-        char* content = (char*)sqlite3_column_text(pStmt, 2);
-        long recordTime = sqlite3_column_int64(pStmt, 3);
-        char* files = (char*)sqlite3_column_text(pStmt, 4);
-        char* access = (char*)sqlite3_column_text(pStmt, 5);
+    sqlite3_reset(pStmt);
+    return 0;
+}
+
+int DatabaseHelper::SaveCursors(const std::vector<std::pair<std::string, Cursor>>& cursors)
+{
+    std::lock_guard<std::mutex> lock(mWriterMutex);
+    sqlite3_stmt* pStmt = mWriter.GetStatement(STMT_SET_CURSOR);
+    if (pStmt == nullptr) {
+        LOGE(LOG_DATABASE, "Save cursors prepare failed");
+        return turn(SQLITE_ERROR);
+    }
+    ScopedTimer timer(mStatementTimes[STMT_SET_CURSOR]);
 
-        Moment moment(id, type, content, recordTime, files, access);
-        json[index] = moment.toJson();
-        index++;
+    char* errMsg;
+    int ret = sqlite3_exec(mWriter.mDb, "BEGIN;", NULL, NULL, &errMsg);
+    if (ret != SQLITE_OK) {
+        LOGE(LOG_DATABASE, "save cursors begin transaction failed ret %d, %s", ret, errMsg);
+        sqlite3_free(errMsg);
+        return turn(ret);
     }
 
-exit:
-    if (pStmt) {
-        sqlite3_finalize(pStmt);
+    for (const auto& item : cursors) {
+        sqlite3_reset(pStmt);
+        sqlite3_bind_text(pStmt, 1, item.first.c_str(), item.first.size(), SQLITE_STATIC);
+        sqlite3_bind_int64(pStmt, 2, item.second.mTime);
+        sqlite3_bind_int(pStmt, 3, item.second.mId);
+
+        ret = Execute(pStmt);
+        if (ret != SQLITE_OK) {
+            sqlite3_exec(mWriter.mDb, "ROLLBACK;", NULL, NULL, NULL);
+            return ret;
+        }
     }
+
+    ret = sqlite3_exec(mWriter.mDb, "COMMIT;", NULL, NULL, NULL);
     return turn(ret);
 }
 
-std::shared_ptr<DatabaseHelper::Moment> DatabaseHelper::GetData(int id)
+int DatabaseHelper::ExplainStatement(const std::string& name, std::vector<std::string>* plan)
 {
-    sqlite3_stmt* pStmt = nullptr;
-    int ret = 0;
-    std::stringstream ss;
-    ss << "SELECT * FROM '" << LIST_TABLE << "'";
-    ss << " WHERE isDelete != 1";
-    ss << " AND id=" << id << ";";
-    std::shared_ptr<DatabaseHelper::Moment> moment;
+    int index = 0;
+    while (index < STMT_COUNT && name.compare(sStatementNames[index])) index++;
+    if (index == STMT_COUNT) {
+        return turn(SQLITE_NOTFOUND);
+    }
 
-    ret = sqlite3_prepare_v2(mDb, ss.str().c_str(), -1, &pStmt, NULL);
+    std::lock_guard<std::mutex> lock(mWriterMutex);
+    std::string sql = std::string("EXPLAIN QUERY PLAN ") + sStatementSql[index];
+    sqlite3_stmt* pStmt;
+    int ret = sqlite3_prepare_v2(mWriter.mDb, sql.c_str(), -1, &pStmt, nullptr);
     if (ret != SQLITE_OK) {
-        printf("Get data prepare failed ret:%d\n", ret);
-        goto exit;
+        LOGE(LOG_DATABASE, "explain %s failed ret %d, %s", name.c_str(), ret, sqlite3_errmsg(mWriter.mDb));
+        return turn(ret);
     }
 
-    if (SQLITE_ROW == sqlite3_step(pStmt)) {
-        int id = sqlite3_column_int(pStmt, 0);
-        int type = sqlite3_column_int(pStmt, 1);
-        char* content = (char*)sqlite3_column_text(pStmt, 2);
-        long recordTime = sqlite3_column_int64(pStmt, 3);
-        char* files = (char*)sqlite3_column_text(pStmt, 4);
-        char* access = (char*)sqlite3_column_text(pStmt, 5);
-
-        moment = std::make_shared<DatabaseHelper::Moment>(id, type, content, recordTime, files, access);
+    plan->clear();
+    while (SQLITE_ROW == sqlite3_step(pStmt)) {
+        plan->push_back(ColumnText(pStmt, 3));
     }
 
-exit:
-    if (pStmt) {
-        sqlite3_finalize(pStmt);
-    }
-    return moment;
+    sqlite3_finalize(pStmt);
+    return 0;
 }
 
 }
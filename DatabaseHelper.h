@@ -4,15 +4,68 @@
 
 #include <sqlite3.h>
 #include <string>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <condition_variable>
+#include <unordered_map>
 #include "Json.hpp"
+#include "Metrics.h"
 
-#define DATA_LIMIT  5
+#define DATA_LIMIT      5
+#define DATA_PAGE_MAX   50
+#define DELTA_LIMIT     100
 
 namespace elastos {
 
+class TimelineCache;
+
 class DatabaseHelper
 {
 public:
+    // non-owning moment, valid as long as the statement row or the Moment
+    // it points into, lets a record be copied once into the output buffer
+    // by a ResultWriter
+    class MomentView
+    {
+    public:
+        MomentView(int id, int type, const char* content, size_t contentLength, long time,
+            const char* files, size_t filesLength, const char* access, size_t accessLength)
+            : mId(id)
+            , mType(type)
+            , mContent(content)
+            , mContentLength(contentLength)
+            , mTime(time)
+            , mFiles(files)
+            , mFilesLength(filesLength)
+            , mAccess(access)
+            , mAccessLength(accessLength)
+        {}
+
+        int mId;
+        int mType;
+        const char* mContent;
+        size_t mContentLength;
+        long mTime;
+        const char* mFiles;
+        size_t mFilesLength;
+        const char* mAccess;
+        size_t mAccessLength;
+    };
+
+    // receives query results as they are read, see ResultWriter.h for the
+    // json and binary implementations
+    class ResultWriter
+    {
+    public:
+        virtual ~ResultWriter() = default;
+
+        virtual void BeginList() = 0;
+        virtual void EndList() = 0;
+        virtual void WriteEntry(int id, long time) = 0;
+        virtual void WriteMoment(const MomentView& moment) = 0;
+    };
+
     class Moment
     {
     public:
@@ -29,6 +82,11 @@ public:
         Json toJson();
         std::string toString();
 
+        int GetId() const { return mId; }
+        long GetTime() const { return mTime; }
+
+        MomentView View() const;
+
     private:
         int mId;
         int mType;
@@ -38,8 +96,63 @@ public:
         std::string mAccess;
     };
 
+    // last moment delivered to a friend
+    class Cursor
+    {
+    public:
+        Cursor(long time = 0, int id = 0)
+            : mTime(time)
+            , mId(id)
+        {}
+
+        bool operator<(const Cursor& other) const {
+            return mTime < other.mTime || (mTime == other.mTime && mId < other.mId);
+        }
+
+        bool operator==(const Cursor& other) const {
+            return mTime == other.mTime && mId == other.mId;
+        }
+
+        long mTime;
+        int mId;
+    };
+
+    // sqlite tuning applied when the database is opened
+    class StorageProfile
+    {
+    public:
+        StorageProfile()
+            : mJournalMode("WAL")
+            , mSynchronous("NORMAL")
+            , mCacheSize(-4096)
+            , mMmapSize(0)
+            , mTempStore("MEMORY")
+            , mBusyTimeout(5000)
+            , mReadConnections(2)
+        {}
+
+        // "default", "flash" (bigger cache, mmap) or "safe" (fsync on every
+        // commit); unknown names fall back to the default profile
+        static StorageProfile FromName(const std::string& name);
+
+        std::string mJournalMode;
+        std::string mSynchronous;
+        int mCacheSize; // pages, or KiB when negative
+        long long mMmapSize; // bytes, 0 disables mmap
+        std::string mTempStore;
+        int mBusyTimeout; // milliseconds
+        int mReadConnections; // read-only handles next to the writer
+    };
+
+    enum class PageDirection {
+        Older,
+        Newer
+    };
+
 public:
-    DatabaseHelper(const std::string& path);
+    // metrics, when given, receive the time of every statement as sql.<name>
+    DatabaseHelper(const std::string& path, const StorageProfile& profile = StorageProfile(),
+                   const std::shared_ptr<Metrics>& metrics = nullptr);
     ~DatabaseHelper();
 
     int SetOwner(const std::string& owner);
@@ -57,24 +170,136 @@ public:
 
     int ClearData();
 
-    int GetData(long time, std::stringstream& data, long* lastTime);
+    // writes the id/time list of up to limit moments after cursor, oldest
+    // first, as a list. last receives the cursor of the final
+    // entry (unchanged when empty) and more is set when moments remain after it.
+    int GetDelta(const Cursor& cursor, int limit, ResultWriter& writer,
+                 Cursor* last, bool* more);
+
+    // writes up to limit moments newer than time, newest first, as a list
+    int GetData(long time, int limit, ResultWriter& writer, int* count);
+
+    // keyset pagination on (time, id): writes up to size moments strictly
+    // older or newer than the cursor, newest first, as a list. A cursor
+    // time <= 0 starts from the newest (Older) or the oldest (Newer) moment.
+    // more is set when further moments exist beyond the returned page.
+    int GetDataPage(long time, int id, PageDirection direction, int size,
+                    ResultWriter& writer, bool* more);
+
+    // writes the moment, nothing when it does not exist
+    int GetData(int id, ResultWriter& writer, bool* found);
 
-    int GetData(long time, Json& json);
+    int LoadCursors(std::unordered_map<std::string, Cursor>& cursors);
 
-    std::shared_ptr<DatabaseHelper::Moment> GetData(int id);
+    // writes all cursors in a single transaction
+    int SaveCursors(const std::vector<std::pair<std::string, Cursor>>& cursors);
+
+    // EXPLAIN QUERY PLAN detail lines of the statement known to metrics as
+    // sql.<name>, for checking that the timeline queries use the index
+    int ExplainStatement(const std::string& name, std::vector<std::string>* plan);
 
 private:
-    bool TableExist(const std::string& name);
+    // statements prepared once and reused, see sStatementSql in DatabaseHelper.cpp
+    enum Statement {
+        STMT_SET_SETTING = 0,
+        STMT_GET_SETTING,
+        STMT_INSERT_DATA,
+        STMT_REMOVE_DATA,
+        STMT_CLEAR_DATA,
+        STMT_GET_ID_DELTA,
+        STMT_GET_DATA_LIST,
+        STMT_GET_DATA,
+        STMT_GET_PAGE_OLDER,
+        STMT_GET_PAGE_NEWER,
+        STMT_HAS_NEWER,
+        STMT_SET_CURSOR,
+        STMT_GET_CURSORS,
+        STMT_COUNT
+    };
+
+    // one sqlite handle with its own prepared statements, used by a single
+    // thread at a time
+    class Connection
+    {
+    public:
+        Connection();
+        ~Connection();
+
+        int Open(const std::string& file, int flags);
+        void Close();
+
+        int Prepare();
+
+        // returns the cached statement reset and with cleared bindings
+        sqlite3_stmt* GetStatement(Statement index);
+
+        sqlite3* mDb;
+        sqlite3_stmt* mStmts[STMT_COUNT];
+    };
+
+    // borrows an idle read connection for the scope, or the writer when
+    // no read connection could be opened
+    class ReadLease
+    {
+    public:
+        ReadLease(DatabaseHelper* helper);
+        ~ReadLease();
+
+        Connection* operator->() { return mConnection; }
+
+    private:
+        DatabaseHelper* mHelper;
+        Connection* mConnection;
+        std::unique_lock<std::mutex> mWriterLock;
+    };
+
+    int ApplyProfile(Connection& connection, const StorageProfile& profile, bool writer);
+
+    // PRAGMA user_version, 0 for a new database
+    int GetSchemaVersion();
+    int CreateSchema();
 
     int CreateSettingTable();
     int CreateDataTable();
+    int CreateDataIndex();
+    int CreateCursorTable();
 
     int CreateTable(const std::string& sql);
 
-    int Insert(const std::string& sql);
+    int SetSetting(const std::string& name, const std::string& value);
+    std::string GetSetting(const std::string& name);
+
+    int Execute(sqlite3_stmt* pStmt);
+
+    static std::shared_ptr<Moment> ReadMoment(sqlite3_stmt* pStmt);
+    static MomentView ReadMomentView(sqlite3_stmt* pStmt);
+
+    int LoadTimeline();
+
+    void CountTimeline(bool hit);
 
 private:
-    sqlite3* mDb;
+    static const char* const sStatementSql[STMT_COUNT];
+    static const char* const sStatementNames[STMT_COUNT];
+
+    // owner writes and schema changes, guarded by mWriterMutex
+    Connection mWriter;
+    std::mutex mWriterMutex;
+
+    // WAL readers for friend requests and pushes
+    std::vector<std::shared_ptr<Connection>> mReaders;
+    std::vector<Connection*> mIdleReaders;
+    std::mutex mReaderMutex;
+    std::condition_variable mReaderCv;
+
+    // newest moments, kept coherent by InsertData, RemoveData and ClearData
+    std::shared_ptr<TimelineCache> mTimeline;
+
+    // null entries when metrics are off
+    std::shared_ptr<Metrics> mMetrics;
+    Histogram* mStatementTimes[STMT_COUNT];
+    Counter* mTimelineHits;
+    Counter* mTimelineMisses;
 };
 
 }
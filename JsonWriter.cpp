@@ -0,0 +1,147 @@
+
+#include "JsonWriter.h"
+#include <cstring>
+#include <cstdio>
+
+namespace elastos {
+
+void JsonWriter::Reset()
+{
+    mBuffer.clear();
+    mFirst.clear();
+    mAfterKey = false;
+}
+
+std::string JsonWriter::Detach()
+{
+    std::string text;
+    text.swap(mBuffer);
+    Reset();
+    return text;
+}
+
+void JsonWriter::Separate()
+{
+    if (mAfterKey) {
+        mAfterKey = false;
+        return;
+    }
+    if (mFirst.empty()) {
+        return;
+    }
+
+    if (mFirst.back()) {
+        mFirst.back() = false;
+    }
+    else {
+        mBuffer.push_back(',');
+    }
+}
+
+JsonWriter& JsonWriter::BeginObject()
+{
+    Separate();
+    mBuffer.push_back('{');
+    mFirst.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndObject()
+{
+    mBuffer.push_back('}');
+    mFirst.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray()
+{
+    Separate();
+    mBuffer.push_back('[');
+    mFirst.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::EndArray()
+{
+    mBuffer.push_back(']');
+    mFirst.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::Key(const char* key)
+{
+    Separate();
+    Escape(key, strlen(key));
+    mBuffer.push_back(':');
+    mAfterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(const char* value, size_t length)
+{
+    Separate();
+    Escape(value, length);
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(const char* value)
+{
+    return String(value, strlen(value));
+}
+
+JsonWriter& JsonWriter::String(const std::string& value)
+{
+    return String(value.data(), value.size());
+}
+
+JsonWriter& JsonWriter::Int(long long value)
+{
+    Separate();
+    char number[24];
+    int length = snprintf(number, sizeof(number), "%lld", value);
+    mBuffer.append(number, length);
+    return *this;
+}
+
+JsonWriter& JsonWriter::Bool(bool value)
+{
+    Separate();
+    mBuffer.append(value ? "true" : "false");
+    return *this;
+}
+
+void JsonWriter::Escape(const char* value, size_t length)
+{
+    static const char* hex = "0123456789abcdef";
+
+    mBuffer.push_back('"');
+    size_t start = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+
+        // copy the plain run in one go, then the escaped character
+        mBuffer.append(value + start, i - start);
+        start = i + 1;
+        switch (c) {
+        case '"':  mBuffer.append("\\\""); break;
+        case '\\': mBuffer.append("\\\\"); break;
+        case '\b': mBuffer.append("\\b"); break;
+        case '\f': mBuffer.append("\\f"); break;
+        case '\n': mBuffer.append("\\n"); break;
+        case '\r': mBuffer.append("\\r"); break;
+        case '\t': mBuffer.append("\\t"); break;
+        default:
+            mBuffer.append("\\u00");
+            mBuffer.push_back(hex[c >> 4]);
+            mBuffer.push_back(hex[c & 0xf]);
+            break;
+        }
+    }
+    mBuffer.append(value + start, length - start);
+    mBuffer.push_back('"');
+}
+
+}
@@ -0,0 +1,54 @@
+#ifndef __ELASTOS_JSON_WRITER_H__
+#define __ELASTOS_JSON_WRITER_H__
+
+#include <string>
+#include <vector>
+
+namespace elastos {
+
+// Appends json text straight into one reusable buffer, commas between
+// members and elements are inserted automatically.
+class JsonWriter
+{
+public:
+    JsonWriter()
+        : mAfterKey(false)
+    {}
+    ~JsonWriter() = default;
+
+    // empties the buffer but keeps its capacity
+    void Reset();
+
+    JsonWriter& BeginObject();
+    JsonWriter& EndObject();
+    JsonWriter& BeginArray();
+    JsonWriter& EndArray();
+
+    JsonWriter& Key(const char* key);
+
+    JsonWriter& String(const char* value, size_t length);
+    JsonWriter& String(const char* value);
+    JsonWriter& String(const std::string& value);
+    JsonWriter& Int(long long value);
+    JsonWriter& Bool(bool value);
+
+    const std::string& str() const { return mBuffer; }
+
+    // moves the text out, leaving the writer empty
+    std::string Detach();
+
+private:
+    void Separate();
+    void Escape(const char* value, size_t length);
+
+private:
+    std::string mBuffer;
+
+    // one entry per open object or array, true until its first value
+    std::vector<bool> mFirst;
+    bool mAfterKey;
+};
+
+}
+
+#endif //__ELASTOS_JSON_WRITER_H__
@@ -0,0 +1,285 @@
+
+#include "Log.h"
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <algorithm>
+#include <string>
+
+// lines per second kept for the chatty per-message categories
+#define LOG_DEFAULT_RATE    100
+
+namespace elastos {
+
+namespace {
+
+const char* const sCategoryNames[LOG_CATEGORY_COUNT] = {
+    "service",
+    "listener",
+    "push",
+    "database",
+    "sender"
+};
+
+const char sLevelNames[] = { 'D', 'I', 'W', 'E' };
+
+// bounded multi-producer ring, each slot carries a sequence number telling
+// producers and the writer whose turn it is
+class Logger
+{
+public:
+    Logger()
+        : mHead(0)
+        , mTail(0)
+        , mDropped(0)
+        , mSleeping(false)
+        , mFlushWaiters(0)
+        , mStop(false)
+    {
+        for (size_t i = 0; i < LOG_RING_SIZE; i++) {
+            mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+        }
+        for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+            mLimits[i].store(0, std::memory_order_relaxed);
+            mWindows[i].store(0, std::memory_order_relaxed);
+            mCounts[i].store(0, std::memory_order_relaxed);
+            mSuppressed[i].store(0, std::memory_order_relaxed);
+        }
+        mLimits[LOG_LISTENER].store(LOG_DEFAULT_RATE, std::memory_order_relaxed);
+        mLimits[LOG_PUSH].store(LOG_DEFAULT_RATE, std::memory_order_relaxed);
+        mLimits[LOG_SENDER].store(LOG_DEFAULT_RATE, std::memory_order_relaxed);
+
+        mThread = std::thread(&Logger::ThreadFun, this);
+    }
+
+    ~Logger()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCv.notify_one();
+        mThread.join();
+    }
+
+    void SetRateLimit(LogCategory category, int perSecond)
+    {
+        mLimits[category].store(perSecond > 0 ? perSecond : 0, std::memory_order_relaxed);
+    }
+
+    void Write(int level, LogCategory category, const char* format, va_list args)
+    {
+        uint32_t suppressed = 0;
+        if (level < LOG_LEVEL_ERROR && !Admit(category, &suppressed)) {
+            return;
+        }
+
+        size_t pos = mHead.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &mSlots[pos & (LOG_RING_SIZE - 1)];
+            size_t sequence = slot->mSequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (mHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else {
+                pos = mHead.load(std::memory_order_relaxed);
+            }
+        }
+
+        int length = snprintf(slot->mLine, LOG_LINE_MAX, "[%c][%s] ",
+                              sLevelNames[level], sCategoryNames[category]);
+        int body = vsnprintf(slot->mLine + length, LOG_LINE_MAX - length, format, args);
+        length = body < 0 ? length : std::min(length + body, LOG_LINE_MAX - 1);
+        if (suppressed > 0 && length < LOG_LINE_MAX - 1) {
+            int extra = snprintf(slot->mLine + length, LOG_LINE_MAX - length,
+                                 " (%u suppressed)", suppressed);
+            length = std::min(length + std::max(extra, 0), LOG_LINE_MAX - 1);
+        }
+        slot->mLength = length;
+
+        // sequentially consistent with the writer going to sleep, either it
+        // sees the line or this sees it asleep
+        slot->mSequence.store(pos + 1);
+        if (mSleeping.load()) {
+            Wake();
+        }
+    }
+
+    void Flush()
+    {
+        size_t target = mHead.load(std::memory_order_acquire);
+        mFlushWaiters.fetch_add(1);
+        Wake();
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFlushCv.wait(lock, [this, target] {
+            return mStop || mTail.load() >= target;
+        });
+        mFlushWaiters.fetch_sub(1);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> mSequence;
+        size_t mLength;
+        char mLine[LOG_LINE_MAX];
+    };
+
+    // the writer only sleeps on an empty ring, the first line after that
+    // takes the mutex once to wake it
+    void Wake()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mSleeping.exchange(false)) {
+            mCv.notify_one();
+        }
+    }
+
+    bool Ready()
+    {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        Slot& slot = mSlots[tail & (LOG_RING_SIZE - 1)];
+        return slot.mSequence.load() == tail + 1;
+    }
+
+    bool Admit(LogCategory category, uint32_t* suppressed)
+    {
+        int limit = mLimits[category].load(std::memory_order_relaxed);
+        if (limit == 0) return true;
+
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = mWindows[category].load(std::memory_order_relaxed);
+        if (window != second && mWindows[category].compare_exchange_strong(window, second)) {
+            mCounts[category].store(0, std::memory_order_relaxed);
+        }
+
+        if (mCounts[category].fetch_add(1, std::memory_order_relaxed) >= limit) {
+            mSuppressed[category].fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        *suppressed = mSuppressed[category].exchange(0, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    // single consumer, writes whatever is ready in one stdio call
+    size_t Drain(std::string& buffer)
+    {
+        size_t count = 0;
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = mSlots[tail & (LOG_RING_SIZE - 1)];
+            if (slot.mSequence.load(std::memory_order_acquire) != tail + 1) break;
+
+            buffer.append(slot.mLine, slot.mLength);
+            buffer.push_back('\n');
+            slot.mSequence.store(tail + LOG_RING_SIZE, std::memory_order_release);
+            tail++;
+            count++;
+        }
+
+        uint64_t dropped = mDropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            char line[64];
+            int length = snprintf(line, sizeof(line), "[W][log] %llu lines dropped\n",
+                                  static_cast<unsigned long long>(dropped));
+            buffer.append(line, length);
+        }
+
+        if (!buffer.empty()) {
+            fwrite(buffer.data(), 1, buffer.size(), stdout);
+            fflush(stdout);
+            buffer.clear();
+        }
+        mTail.store(tail);
+
+        if (count > 0 && mFlushWaiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mFlushCv.notify_all();
+        }
+
+        return count;
+    }
+
+    void ThreadFun()
+    {
+        std::string buffer;
+        while (true) {
+            if (Drain(buffer) > 0) continue;
+
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mStop) break;
+            mSleeping.store(true);
+            if (Ready()) {
+                mSleeping.store(false);
+                continue;
+            }
+            mCv.wait(lock, [this] { return mStop || !mSleeping.load(); });
+        }
+        Drain(buffer);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFlushCv.notify_all();
+    }
+
+private:
+    Slot mSlots[LOG_RING_SIZE];
+    std::atomic<size_t> mHead;
+    std::atomic<size_t> mTail;
+    std::atomic<uint64_t> mDropped;
+
+    std::atomic<int> mLimits[LOG_CATEGORY_COUNT];
+    std::atomic<int64_t> mWindows[LOG_CATEGORY_COUNT];
+    std::atomic<int> mCounts[LOG_CATEGORY_COUNT];
+    std::atomic<uint32_t> mSuppressed[LOG_CATEGORY_COUNT];
+
+    // guarded by mMutex when set, read by producers without it
+    std::atomic<bool> mSleeping;
+    std::atomic<int> mFlushWaiters;
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::condition_variable mFlushCv;
+    bool mStop;
+    std::thread mThread;
+};
+
+Logger& GetLogger()
+{
+    static Logger logger;
+    return logger;
+}
+
+}
+
+void Log::SetRateLimit(LogCategory category, int perSecond)
+{
+    GetLogger().SetRateLimit(category, perSecond);
+}
+
+void Log::Write(int level, LogCategory category, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    GetLogger().Write(level, category, format, args);
+    va_end(args);
+}
+
+void Log::Flush()
+{
+    GetLogger().Flush();
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef __ELASTOS_LOG_H__
+#define __ELASTOS_LOG_H__
+
+#include <cstddef>
+
+#define LOG_LEVEL_DEBUG     0
+#define LOG_LEVEL_INFO      1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_ERROR     3
+#define LOG_LEVEL_NONE      4
+
+// calls below this level are compiled out together with their arguments
+#ifndef MOMENTS_LOG_LEVEL
+#define MOMENTS_LOG_LEVEL   LOG_LEVEL_INFO
+#endif
+
+// lines waiting for the writer thread, a power of two; lines beyond are
+// dropped and counted rather than blocking the caller
+#define LOG_RING_SIZE       1024
+#define LOG_LINE_MAX        256
+
+#define MOMENTS_LOG(level, category, ...) \
+    do { \
+        if ((level) >= MOMENTS_LOG_LEVEL) { \
+            ::elastos::Log::Write((level), (category), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOGD(category, ...)     MOMENTS_LOG(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOGI(category, ...)     MOMENTS_LOG(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOGW(category, ...)     MOMENTS_LOG(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LOGE(category, ...)     MOMENTS_LOG(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+
+namespace elastos {
+
+enum LogCategory {
+    LOG_SERVICE = 0,
+    LOG_LISTENER,
+    LOG_PUSH,
+    LOG_DATABASE,
+    LOG_SENDER,
+    LOG_CATEGORY_COUNT
+};
+
+// Leveled logging written to stdout by a background thread. Callers only
+// format into a slot of a lock-free ring, they never touch the stream.
+class Log
+{
+public:
+    // keeps at most perSecond lines of category per second, the rest are
+    // counted and reported with the next kept line; 0 keeps everything.
+    // Errors are never limited
+    static void SetRateLimit(LogCategory category, int perSecond);
+
+    // use the LOG* macros so disabled levels cost nothing
+    static void Write(int level, LogCategory category, const char* format, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+
+    // returns once every line queued before the call has been written
+    static void Flush();
+};
+
+}
+
+#endif //__ELASTOS_LOG_H__
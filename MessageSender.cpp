@@ -0,0 +1,70 @@
+
+#include "MessageSender.h"
+#include "Log.h"
+
+namespace elastos {
+
+MessageSender::MessageSender(const std::shared_ptr<Connector>& connector,
+                             const std::shared_ptr<TaskGroup>& tasks, Histogram* sendTime)
+    : mConnector(connector)
+    , mTasks(tasks)
+    , mSendTime(sendTime)
+{
+}
+
+MessageSender::~MessageSender()
+{
+    Stop();
+}
+
+void MessageSender::Start()
+{
+    mTasks->Open();
+}
+
+void MessageSender::Stop()
+{
+    mTasks->Close();
+}
+
+void MessageSender::Post(const std::string& humanCode, const std::shared_ptr<const std::string>& message,
+                         WireFormat format, Callback callback)
+{
+    bool posted = mTasks->Post(humanCode, [this, humanCode, message, format, callback] {
+        int ret;
+        {
+            ScopedTimer timer(mSendTime);
+            ret = Send(*mConnector, humanCode, format, *message);
+        }
+        if (ret != 0) {
+            LOGW(LOG_SENDER, "Message sender send to %s failed %d", humanCode.c_str(), ret);
+        }
+        if (callback) {
+            callback(ret);
+        }
+    });
+    if (!posted) {
+        LOGW(LOG_SENDER, "Message sender dropped message to %s", humanCode.c_str());
+        if (callback) {
+            callback(-1);
+        }
+    }
+}
+
+size_t MessageSender::Size()
+{
+    return mTasks->Size();
+}
+
+int MessageSender::Send(Connector& connector, const std::string& humanCode,
+                        WireFormat format, const std::string& message)
+{
+    if (format == WireFormat::Binary) {
+        std::vector<uint8_t> binary(message.begin(), message.end());
+        return connector.SendMessage(humanCode, binary);
+    }
+
+    return connector.SendMessage(humanCode, message);
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef __ELASTOS_MESSAGE_SENDER_H__
+#define __ELASTOS_MESSAGE_SENDER_H__
+
+#include <string>
+#include <memory>
+#include <functional>
+#include "Connector.h"
+#include "BinaryFormat.h"
+#include "Metrics.h"
+#include "WorkerPool.h"
+
+namespace elastos {
+
+// Outbound messages sent on the host workers, so callers never block on
+// Connector::SendMessage. Messages to the same friend keep their order.
+class MessageSender
+{
+public:
+    // invoked on a worker with the SendMessage result
+    typedef std::function<void(int result)> Callback;
+
+    // sendTime, when given, records every SendMessage call
+    MessageSender(const std::shared_ptr<Connector>& connector, const std::shared_ptr<TaskGroup>& tasks,
+                  Histogram* sendTime = nullptr);
+    ~MessageSender();
+
+    void Start();
+
+    // messages still queued are dropped without callback, returns once no
+    // send is running
+    void Stop();
+
+    // the callback gets -1 right away when the message cannot be queued
+    void Post(const std::string& humanCode, const std::shared_ptr<const std::string>& message,
+              WireFormat format, Callback callback = nullptr);
+
+    size_t Size();
+
+    // json goes out as a text message, binary frames as a binary message
+    // since they hold 0 bytes and are not utf-8
+    static int Send(Connector& connector, const std::string& humanCode,
+                    WireFormat format, const std::string& message);
+
+private:
+    std::shared_ptr<Connector> mConnector;
+    std::shared_ptr<TaskGroup> mTasks;
+    Histogram* mSendTime;
+};
+
+}
+
+#endif //__ELASTOS_MESSAGE_SENDER_H__
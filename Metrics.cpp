@@ -0,0 +1,160 @@
+
+#include "Metrics.h"
+#include <fstream>
+
+namespace elastos {
+
+Histogram::Histogram()
+    : mCount(0)
+    , mSum(0)
+    , mMax(0)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        mBuckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::Record(uint64_t value)
+{
+    mBuckets[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mSum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = mMax.load(std::memory_order_relaxed);
+    while (value > max && !mMax.compare_exchange_weak(max, value, std::memory_order_relaxed));
+}
+
+int Histogram::Bucket(uint64_t value)
+{
+    const uint64_t sub = 1ULL << HISTOGRAM_SUB_BITS;
+    if (value < sub) {
+        return static_cast<int>(value);
+    }
+
+    int msb = 63 - __builtin_clzll(value);
+    if (msb > HISTOGRAM_MAX_BITS) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+
+    // the bits right below the leading one pick the linear bucket
+    int shift = msb - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + static_cast<int>((value >> shift) & (sub - 1));
+}
+
+uint64_t Histogram::BucketValue(int bucket)
+{
+    const int sub = 1 << HISTOGRAM_SUB_BITS;
+    if (bucket < sub) {
+        return bucket;
+    }
+
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    return static_cast<uint64_t>(sub + (bucket & (sub - 1))) << shift;
+}
+
+uint64_t Histogram::Percentile(double fraction, uint64_t count) const
+{
+    uint64_t rank = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            return BucketValue(i);
+        }
+    }
+
+    return mMax.load(std::memory_order_relaxed);
+}
+
+Json Histogram::ToJson() const
+{
+    uint64_t count = Count();
+
+    Json json;
+    json["count"] = count;
+    json["mean"] = count > 0 ? mSum.load(std::memory_order_relaxed) / count : 0;
+    json["p50"] = Percentile(0.5, count);
+    json["p90"] = Percentile(0.9, count);
+    json["p99"] = Percentile(0.99, count);
+    json["max"] = mMax.load(std::memory_order_relaxed);
+
+    return json;
+}
+
+Counter* Metrics::GetCounter(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& counter = mCounters[name];
+    if (counter == nullptr) {
+        counter.reset(new Counter());
+    }
+
+    return counter.get();
+}
+
+Histogram* Metrics::GetHistogram(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto& histogram = mHistograms[name];
+    if (histogram == nullptr) {
+        histogram.reset(new Histogram());
+    }
+
+    return histogram.get();
+}
+
+void Metrics::SetGauge(const std::string& name, Gauge gauge)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGauges[name] = std::move(gauge);
+}
+
+Json Metrics::ToJson()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    Json counters = Json::object();
+    for (auto& counter : mCounters) {
+        counters[counter.first] = counter.second->Get();
+    }
+
+    // gauges take their owners' locks, which may be held by a thread
+    // waiting for this one, so they are read without it
+    auto gaugeList = mGauges;
+    lock.unlock();
+    Json gauges = Json::object();
+    for (auto& gauge : gaugeList) {
+        gauges[gauge.first] = gauge.second();
+    }
+    lock.lock();
+
+    // latencies in microseconds, unused histograms are left out
+    Json histograms = Json::object();
+    for (auto& histogram : mHistograms) {
+        if (histogram.second->Count() > 0) {
+            histograms[histogram.first] = histogram.second->ToJson();
+        }
+    }
+
+    Json json;
+    json["counters"] = counters;
+    json["gauges"] = gauges;
+    json["histograms"] = histograms;
+
+    return json;
+}
+
+int Metrics::DumpToFile(const std::string& file)
+{
+    std::string content = ToJson().dump(2);
+
+    std::ofstream out(file, std::ios::trunc);
+    if (!out) {
+        return -1;
+    }
+    out << content << std::endl;
+
+    return out.good() ? 0 : -1;
+}
+
+}
@@ -0,0 +1,115 @@
+#ifndef __ELASTOS_METRICS_H__
+#define __ELASTOS_METRICS_H__
+
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "Json.hpp"
+
+// histogram buckets: exact below 2^HISTOGRAM_SUB_BITS, then that many
+// linear buckets per power of two (about 6% error), up to 2^HISTOGRAM_MAX_BITS
+#define HISTOGRAM_SUB_BITS      4
+#define HISTOGRAM_MAX_BITS      40
+#define HISTOGRAM_BUCKETS       ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) << HISTOGRAM_SUB_BITS)
+
+namespace elastos {
+
+class Counter
+{
+public:
+    Counter()
+        : mValue(0)
+    {}
+
+    void Add(uint64_t value = 1) { mValue.fetch_add(value, std::memory_order_relaxed); }
+    uint64_t Get() const { return mValue.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> mValue;
+};
+
+// HDR-style latency histogram in microseconds, recording is wait-free
+class Histogram
+{
+public:
+    Histogram();
+
+    void Record(uint64_t value);
+
+    uint64_t Count() const { return mCount.load(std::memory_order_relaxed); }
+
+    // count, mean, p50, p90, p99 and max
+    Json ToJson() const;
+
+private:
+    static int Bucket(uint64_t value);
+    static uint64_t BucketValue(int bucket);
+
+    uint64_t Percentile(double fraction, uint64_t count) const;
+
+    std::atomic<uint64_t> mBuckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSum;
+    std::atomic<uint64_t> mMax;
+};
+
+// records the lifetime of the scope into histogram, nothing when null
+class ScopedTimer
+{
+public:
+    ScopedTimer(Histogram* histogram)
+        : mHistogram(histogram)
+    {
+        if (mHistogram != nullptr) {
+            mStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedTimer()
+    {
+        if (mHistogram != nullptr) {
+            auto elapsed = std::chrono::steady_clock::now() - mStart;
+            mHistogram->Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        }
+    }
+
+private:
+    Histogram* mHistogram;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+// Named counters, histograms and gauges. Lookups take a lock, so callers
+// fetch their metrics once and keep the pointers, which stay valid for
+// the lifetime of the registry.
+class Metrics
+{
+public:
+    // sampled when the metrics are dumped
+    typedef std::function<int64_t()> Gauge;
+
+    Metrics() = default;
+    ~Metrics() = default;
+
+    Counter* GetCounter(const std::string& name);
+    Histogram* GetHistogram(const std::string& name);
+    void SetGauge(const std::string& name, Gauge gauge);
+
+    Json ToJson();
+
+    int DumpToFile(const std::string& file);
+
+private:
+    std::mutex mMutex;
+    std::map<std::string, std::unique_ptr<Counter>> mCounters;
+    std::map<std::string, std::unique_ptr<Histogram>> mHistograms;
+    std::map<std::string, Gauge> mGauges;
+};
+
+}
+
+#endif //__ELASTOS_METRICS_H__
@@ -1,35 +1,105 @@
 
 #include "MomentsListener.h"
 #include "Json.hpp"
+#include "Log.h"
+#include <algorithm>
 
 namespace elastos {
 
+struct MomentsListener::Commands
+{
+    static constexpr Command sTable[] = {
+        { "setting", &MomentsListener::HandleSetting, RequestClass::Owner,
+          { { "type", FIELD_STRING, true }, { "value", FIELD_BOOLEAN, true } } },
+        { "getData", &MomentsListener::HandleGetData, RequestClass::Read,
+          { { "id", FIELD_INTEGER, true } } },
+        { "getDataList", &MomentsListener::HandleGetDataList, RequestClass::Read,
+          { { "time", FIELD_INTEGER, true }, { "size", FIELD_INTEGER, false } } },
+        { "getDataPage", &MomentsListener::HandleGetDataPage, RequestClass::Read,
+          { { "time", FIELD_INTEGER, false }, { "id", FIELD_INTEGER, false },
+            { "direction", FIELD_STRING, false, "older|newer" }, { "size", FIELD_INTEGER, false } } },
+        { "setFormat", &MomentsListener::HandleSetFormat, RequestClass::Control,
+          { { "format", FIELD_STRING, false } } },
+        { "delete", &MomentsListener::HandleDelete, RequestClass::Owner,
+          { { "id", FIELD_INTEGER, true } } },
+        { "clear", &MomentsListener::HandleClear, RequestClass::Owner, {} },
+        { "getSetting", &MomentsListener::HandleGetSetting, RequestClass::Owner,
+          { { "type", FIELD_STRING, true } } },
+        { "publish", &MomentsListener::HandlePublish, RequestClass::Owner,
+          { { "type", FIELD_INTEGER, true }, { "content", FIELD_STRING, true },
+            { "time", FIELD_INTEGER, true }, { "access", FIELD_STRING, true } } },
+        { "acceptFriend", &MomentsListener::AcceptFriend, RequestClass::Owner,
+          { { "friendCode", FIELD_STRING, true } } },
+        { "getFollowList", &MomentsListener::HandleGetFollowList, RequestClass::Owner, {} },
+        { "getStats", &MomentsListener::HandleGetStats, RequestClass::Owner,
+          { { "file", FIELD_BOOLEAN, false } } },
+    };
+
+    static constexpr size_t sCount = sizeof(sTable) / sizeof(sTable[0]);
+
+    static constexpr uint32_t Slot(size_t index) {
+        return Hash(sTable[index].mName) & (COMMAND_SLOTS - 1);
+    }
+
+    static constexpr bool Collides(size_t index, size_t other) {
+        return other < sCount && (Slot(index) == Slot(other) || Collides(index, other + 1));
+    }
+
+    static constexpr bool Perfect(size_t index = 0) {
+        return index >= sCount || (!Collides(index, index + 1) && Perfect(index + 1));
+    }
+};
+
+constexpr MomentsListener::Command MomentsListener::Commands::sTable[];
+
+MomentsListener::MomentsListener(MomentsService* service)
+    : mService(service)
+{
+    Metrics* metrics = mService->mMetrics.get();
+    for (const Command& command : Commands::sTable) {
+        mCommandTimes.push_back(metrics->GetHistogram(std::string("command.") + command.mName));
+    }
+    mDropped = metrics->GetCounter("listener.dropped");
+    mRejected = metrics->GetCounter("listener.rejected");
+    mInvalid = metrics->GetCounter("listener.invalid");
+}
+
 void MomentsListener::onEvent(ElaphantContact::Listener::EventArgs& event)
 {
     switch (event.type) {
     case ElaphantContact::Listener::EventType::StatusChanged:
     {
         auto statusEvent = dynamic_cast<ElaphantContact::Listener::StatusEvent*>(&event);
-        printf("Serice %s received %s status changed %hhu\n", MOMENTS_SERVICE_NAME, event.humanCode.c_str(), statusEvent->status);
+        LOGI(LOG_LISTENER, "Serice %s received %s status changed %d", MOMENTS_SERVICE_NAME, event.humanCode.c_str(), static_cast<int>(statusEvent->status));
         HandleStatusChanged(statusEvent);
         break;
     }
     case ElaphantContact::Listener::EventType::FriendRequest:
     {
         auto requestEvent = dynamic_cast<ElaphantContact::Listener::RequestEvent*>(&event);
-        printf("Serice %s received %s friend request %s\n", MOMENTS_SERVICE_NAME, event.humanCode.c_str(), requestEvent->summary.c_str());
-        HandleFriendRequest(requestEvent);
+        LOGI(LOG_LISTENER, "Serice %s received %s friend request %s", MOMENTS_SERVICE_NAME, event.humanCode.c_str(), requestEvent->summary.c_str());
+        std::string humanCode = event.humanCode;
+        std::string summary = requestEvent->summary;
+        mService->Touch();
+        bool posted = mService->mTasks->Post(humanCode, [this, humanCode, summary] {
+            mService->Activate();
+            HandleFriendRequest(humanCode, summary);
+        });
+        if (!posted) {
+            mDropped->Add();
+            LOGW(LOG_LISTENER, "Service %s busy, dropped friend request from %s", MOMENTS_SERVICE_NAME, humanCode.c_str());
+        }
         break;
     }
     case ElaphantContact::Listener::EventType::HumanInfoChanged:
     {
         auto infoEvent = dynamic_cast<ElaphantContact::Listener::InfoEvent*>(&event);
-        std::string content = infoEvent->toString();
-        printf("Serice %s received %s info changed %s\n", MOMENTS_SERVICE_NAME, event.humanCode.c_str(), content.c_str());
+        LOGD(LOG_LISTENER, "Serice %s received %s info changed %s", MOMENTS_SERVICE_NAME, event.humanCode.c_str(),
+             infoEvent->toString().c_str());
         break;
     }
     default:
-        printf("Unprocessed event: %d", static_cast<int>(event.type));
+        LOGD(LOG_LISTENER, "Unprocessed event: %d", static_cast<int>(event.type));
         break;
     }
 }
@@ -37,72 +107,236 @@ void MomentsListener::onEvent(ElaphantContact::Listener::EventArgs& event)
 void MomentsListener::onReceivedMessage(const std::string& humanCode, ElaphantContact::Channel channelType,
                                std::shared_ptr<ElaphantContact::Message> msgInfo)
 {
-    printf("Service %s received message %s from %s\n", MOMENTS_SERVICE_NAME, msgInfo->data->toString().c_str(), humanCode.c_str());
-    try {
-        Json content = Json::parse(msgInfo->data->toString());
-        std::string command = content["command"];
+    std::string message = msgInfo->data->toString();
+    LOGD(LOG_LISTENER, "Service %s received message %s from %s", MOMENTS_SERVICE_NAME, message.c_str(), humanCode.c_str());
+
+    // a cold tenant loads on the worker, never on the carrier thread
+    mService->Touch();
 
-        if (!command.compare("setting")) {
-            HandleSetting(humanCode, content);
+    // a flooding friend must not fill the worker queue shared with the
+    // other friends and tenants, its surplus is rejected here. The owner
+    // is only known once the settings are loaded, until then it is
+    // counted like any friend.
+    bool counted = humanCode.compare(mService->GetOwner()) != 0;
+    if (counted) {
+        bool notify = false;
+        if (!Enqueue(humanCode, &notify)) {
+            mRejected->Add();
+            if (notify) {
+                bool posted = mService->mTasks->Post(humanCode, [this, humanCode, message] {
+                    HandleRejected(humanCode, message);
+                });
+                if (!posted) HandleRejected(humanCode, message);
+            }
+            return;
         }
-        else if (!command.compare("getData")) {
-            HandleGetData(humanCode, content);
+    }
+
+    // keep the carrier thread free, the handlers query and send
+    bool posted = mService->mTasks->Post(humanCode, [this, humanCode, message, counted] {
+        mService->Activate();
+        HandleMessage(humanCode, message);
+        if (counted) Dequeue(humanCode);
+    });
+    if (!posted) {
+        if (counted) Dequeue(humanCode);
+        mDropped->Add();
+        LOGW(LOG_LISTENER, "Service %s busy, dropped message from %s", MOMENTS_SERVICE_NAME, humanCode.c_str());
+        // the workers are full, tell the sender here so a publish or a
+        // page request is retried instead of lost
+        HandleRejected(humanCode, message);
+    }
+}
+
+bool MomentsListener::Enqueue(const std::string& humanCode, bool* notify)
+{
+    int limit = mService->mSenderQueueLimit;
+    std::unique_lock<std::mutex> _lock(mQueuedMutex);
+    Queued& queued = mQueued[humanCode];
+    if (limit > 0 && queued.mCount >= limit) {
+        *notify = !queued.mNotified;
+        queued.mNotified = true;
+        return false;
+    }
+
+    queued.mCount++;
+    return true;
+}
+
+void MomentsListener::Dequeue(const std::string& humanCode)
+{
+    std::unique_lock<std::mutex> _lock(mQueuedMutex);
+    auto it = mQueued.find(humanCode);
+    if (it == mQueued.end()) return;
+
+    it->second.mNotified = false;
+    if (--it->second.mCount <= 0) {
+        mQueued.erase(it);
+    }
+}
+
+void MomentsListener::HandleRejected(const std::string& humanCode, const std::string& message)
+{
+    try {
+        Json content = Json::parse(message);
+        if (content.is_object() && content["command"].is_string()) {
+            mService->BusyResponse(humanCode, content["command"], SENDER_RETRY_AFTER);
         }
-        else if (!command.compare("getDataList")) {
-            HandleGetDataList(humanCode, content);
+    } catch (const std::exception& e) {
+        LOGW(LOG_LISTENER, "Service moment parse json failed");
+    }
+}
+
+void MomentsListener::HandleMessage(const std::string& humanCode, const std::string& message)
+{
+    try {
+        Json content = Json::parse(message);
+        if (!content.is_object() || !content["command"].is_string()) {
+            LOGW(LOG_LISTENER, "Service moment message without command");
+            return;
         }
-        else if (!command.compare("delete")) {
-            HandleDelete(humanCode, content);
+        std::string name = content["command"];
+
+        const Command* command = FindCommand(name);
+        if (command == nullptr) {
+            LOGW(LOG_LISTENER, "Not support command %s", name.c_str());
+            return;
         }
-        else if (!command.compare("clear")) {
-            HandleClear(humanCode);
+        std::string owner = mService->GetOwner();
+        if (command->mClass == RequestClass::Owner) {
+            if (humanCode.compare(owner)) {
+                LOGW(LOG_LISTENER, "This is an owner command");
+                return;
+            }
         }
-        else if (!command.compare("getSetting")) {
-            HandleGetSetting(humanCode, content);
+        else if (humanCode.compare(owner)) {
+            long retryAfter = 0;
+            if (!mService->mRateLimiter->Admit(humanCode, command->mClass, &retryAfter)) {
+                mRejected->Add();
+                // one notice per throttled period, later requests are dropped silently
+                if (retryAfter > 0) {
+                    mService->BusyResponse(humanCode, name, retryAfter);
+                }
+                return;
+            }
         }
-        else if (!command.compare("publish")) {
-            HandlePublish(humanCode, content);
+        if (!Validate(*command, content)) {
+            mInvalid->Add();
+            LOGW(LOG_LISTENER, "Invalid %s command from %s", name.c_str(), humanCode.c_str());
+            return;
         }
-        else if (!command.compare("acceptFriend")) {
-            AcceptFriend(humanCode, content);
+
+        ScopedTimer timer(mCommandTimes[command - Commands::sTable]);
+        (this->*command->mHandler)(humanCode, content);
+    } catch (const std::exception& e) {
+        LOGW(LOG_LISTENER, "Service moment parse json failed");
+    }
+}
+
+uint32_t MomentsListener::Hash(const std::string& name)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+
+    return hash;
+}
+
+const MomentsListener::Command* MomentsListener::FindCommand(const std::string& name)
+{
+    static_assert((COMMAND_SLOTS & (COMMAND_SLOTS - 1)) == 0, "COMMAND_SLOTS must be a power of two");
+    static_assert(Commands::Perfect(), "two commands share a slot, raise COMMAND_SLOTS");
+
+    static const std::vector<const Command*> slots = [] {
+        std::vector<const Command*> table(COMMAND_SLOTS, nullptr);
+        for (const Command& command : Commands::sTable) {
+            table[Commands::Slot(&command - Commands::sTable)] = &command;
         }
-        else if (!command.compare("getFollowList")) {
-            HandleGetFollowList(humanCode);
+        return table;
+    }();
+
+    const Command* command = slots[Hash(name) & (COMMAND_SLOTS - 1)];
+    if (command == nullptr || name.compare(command->mName)) {
+        return nullptr;
+    }
+
+    return command;
+}
+
+bool MomentsListener::Validate(const Command& command, const Json& json)
+{
+    for (const Field& field : command.mFields) {
+        if (field.mName == nullptr) break;
+
+        auto it = json.find(field.mName);
+        if (it == json.end()) {
+            if (field.mRequired) return false;
+            continue;
         }
-        else {
-            printf("Not support command %s\n", command.c_str());
+
+        bool valid = false;
+        switch (field.mType) {
+        case FIELD_STRING:
+            valid = it->is_string() && (field.mValues == nullptr || IsOneOf(it->get<std::string>(), field.mValues));
+            break;
+        case FIELD_INTEGER:
+            valid = it->is_number_integer();
+            break;
+        case FIELD_BOOLEAN:
+            valid = it->is_boolean();
+            break;
         }
+        if (!valid) return false;
+    }
 
-    } catch (const std::exception& e) {
-        printf("Service moment parse json failed\n");
+    return true;
+}
+
+bool MomentsListener::IsOneOf(const std::string& value, const char* values)
+{
+    const char* start = values;
+    while (true) {
+        const char* end = start;
+        while (*end != '\0' && *end != '|') end++;
+        if (value.size() == static_cast<size_t>(end - start) && value.compare(0, value.size(), start, end - start) == 0) {
+            return true;
+        }
+        if (*end == '\0') return false;
+        start = end + 1;
     }
 }
 
-void MomentsListener::HandleFriendRequest(ElaphantContact::Listener::RequestEvent* event)
+void MomentsListener::HandleFriendRequest(const std::string& humanCode, const std::string& summary)
 {
     if (mService->mPrivate) {
         Json content;
         content["command"] = "friendRequest";
-        content["friendCode"] = event->humanCode;
-        Json summary = Json::parse(event->summary);
-        content["summary"] = summary["content"];
+        content["friendCode"] = humanCode;
+        try {
+            Json json = Json::parse(summary);
+            content["summary"] = json["content"];
+        } catch (const std::exception& e) {
+            LOGW(LOG_LISTENER, "Service moment parse friend request summary failed");
+            return;
+        }
 
-        mService->mConnector->SendMessage(mService->mOwner, content.dump());
+        mService->SendMessage(mService->GetOwner(), content.dump());
     }
     else {
         bool notify = false;
-        if (mService->mOwner.empty()) {
+        if (mService->GetOwner().empty()) {
             // only did user can be owner
-            if (!mService->IsDid(event->humanCode)) return;
-            mService->SetOwner(event->humanCode);
+            if (!mService->IsDid(humanCode)) return;
+            mService->SetOwner(humanCode);
         }
         else {
             notify = true;
         }
 
-        mService->mConnector->AcceptFriend(event->humanCode);
+        mService->mConnector->AcceptFriend(humanCode);
         if (notify) {
-            mService->SendNewFollow(event->humanCode);
+            mService->SendNewFollow(humanCode);
         }
     }
 }
@@ -119,10 +353,6 @@ void MomentsListener::HandleStatusChanged(ElaphantContact::Listener::StatusEvent
 
 void MomentsListener::HandleSetting(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
-    }
     std::string type = json["type"];
     if (!type.compare("access")) {
         bool priv = json["value"];
@@ -133,33 +363,19 @@ void MomentsListener::HandleSetting(const std::string& humanCode, const Json& js
 
 void MomentsListener::HandleDelete(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
-    }
-
     int id = json["id"];
     int ret = mService->Remove(id);
     mService->DeleteResponse(id, ret);
 }
 
-void MomentsListener::HandleClear(const std::string& humanCode)
+void MomentsListener::HandleClear(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
-    }
     int ret = mService->Clear();
     mService->ClearResponse(ret);
 }
 
 void MomentsListener::HandlePublish(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
-    }
-
     int type = json["type"];
     std::string content = json["content"];
     long time = json["time"];
@@ -170,21 +386,12 @@ void MomentsListener::HandlePublish(const std::string& humanCode, const Json& js
 
 void MomentsListener::AcceptFriend(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
-    }
     std::string friendCode = json["friendCode"];
     mService->mConnector->AcceptFriend(friendCode);
 }
 
 void MomentsListener::HandleGetSetting(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
-    }
-
     std::string type = json["type"];
     mService->SendSetting(type);
 }
@@ -198,16 +405,50 @@ void MomentsListener::HandleGetData(const std::string& humanCode, const Json& js
 void MomentsListener::HandleGetDataList(const std::string& humanCode, const Json& json)
 {
     long time = json["time"];
-    mService->SendDataList(humanCode, time);
+    int size = json.value("size", DATA_LIMIT);
+    size = std::max(1, std::min(size, DATA_PAGE_MAX));
+    mService->SendDataList(humanCode, time, size);
 }
 
-void MomentsListener::HandleGetFollowList(const std::string& humanCode)
+void MomentsListener::HandleGetDataPage(const std::string& humanCode, const Json& json)
 {
-    if (humanCode.compare(mService->mOwner)) {
-        printf("This is an owner command\n");
-        return;
+    long time = json.value("time", 0L);
+    int id = json.value("id", 0);
+    // validated against the command table, only older or newer
+    auto direction = DatabaseHelper::PageDirection::Older;
+    if (json.value("direction", "older") == "newer") {
+        direction = DatabaseHelper::PageDirection::Newer;
     }
+    int size = json.value("size", DATA_LIMIT);
+    size = std::max(1, std::min(size, DATA_PAGE_MAX));
+    mService->SendDataPage(humanCode, time, id, direction, size);
+}
+
+void MomentsListener::HandleSetFormat(const std::string& humanCode, const Json& json)
+{
+    std::string format = json.value("format", "json");
+    int ret = 0;
+    if (!format.compare("binary")) {
+        ret = mService->SetFormat(humanCode, WireFormat::Binary);
+    }
+    else if (!format.compare("json")) {
+        ret = mService->SetFormat(humanCode, WireFormat::Json);
+    }
+    else {
+        LOGW(LOG_LISTENER, "Not support format %s", format.c_str());
+        ret = -1;
+    }
+    mService->FormatResponse(humanCode, format, ret);
+}
+
+void MomentsListener::HandleGetFollowList(const std::string& humanCode, const Json& json)
+{
     mService->SendFollowList(humanCode);
 }
 
+void MomentsListener::HandleGetStats(const std::string& humanCode, const Json& json)
+{
+    mService->SendStats(json.value("file", false));
+}
+
 }
@@ -4,15 +4,21 @@
 
 #include "PeerListener.h"
 #include "MomentsService.h"
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// inbound command lookup slots, must be a power of two; MomentsListener.cpp
+// fails to compile when two commands land in the same slot
+#define COMMAND_SLOTS       32
+#define COMMAND_FIELD_MAX   4
 
 namespace elastos {
 
 class MomentsListener : public PeerListener::MessageListener
 {
 public:
-    MomentsListener(MomentsService* service)
-        : mService(service)
-    {}
+    MomentsListener(MomentsService* service);
 
     ~MomentsListener() = default;
 
@@ -21,22 +27,91 @@ public:
                                std::shared_ptr<ElaphantContact::Message> msgInfo) override;
 
 private:
-    void HandleFriendRequest(ElaphantContact::Listener::RequestEvent* event);
+    // runs on the sender's worker
+    void HandleMessage(const std::string& humanCode, const std::string& message);
+    // the busy reply for a message rejected by Enqueue, on the worker, or
+    // on the carrier thread when the workers are full
+    void HandleRejected(const std::string& humanCode, const std::string& message);
+
+    // false when the friend already has the service's sender queue limit
+    // of messages waiting, notify is then set once until one is handled
+    bool Enqueue(const std::string& humanCode, bool* notify);
+    void Dequeue(const std::string& humanCode);
+
+    // runs on the requester's worker
+    void HandleFriendRequest(const std::string& humanCode, const std::string& summary);
     void HandleStatusChanged(ElaphantContact::Listener::StatusEvent* event);
 
     void HandleSetting(const std::string& humanCode, const Json& json);
     void HandleDelete(const std::string& humanCode, const Json& json);
-    void HandleClear(const std::string& humanCode);
+    void HandleClear(const std::string& humanCode, const Json& json);
     void HandlePublish(const std::string& humanCode, const Json& json);
     void AcceptFriend(const std::string& humanCode, const Json& json);
 
     void HandleGetSetting(const std::string& humanCode, const Json& json);
     void HandleGetData(const std::string& humanCode, const Json& json);
     void HandleGetDataList(const std::string& humanCode, const Json& json);
-    void HandleGetFollowList(const std::string& humanCode);
+    void HandleGetDataPage(const std::string& humanCode, const Json& json);
+    void HandleSetFormat(const std::string& humanCode, const Json& json);
+    void HandleGetFollowList(const std::string& humanCode, const Json& json);
+    void HandleGetStats(const std::string& humanCode, const Json& json);
+
+    enum FieldType {
+        FIELD_STRING,
+        FIELD_INTEGER,
+        FIELD_BOOLEAN
+    };
+
+    struct Field {
+        const char* mName;
+        FieldType mType;
+        bool mRequired;
+        // strings only, the accepted values separated by '|', any when null
+        const char* mValues;
+    };
+
+    typedef void (MomentsListener::*Handler)(const std::string& humanCode, const Json& json);
+
+    // a registered command, handlers only run once the sender, its budget
+    // and the fields have been checked against it
+    struct Command {
+        const char* mName;
+        Handler mHandler;
+        RequestClass mClass;
+        Field mFields[COMMAND_FIELD_MAX];
+    };
+
+    // the command table, defined in MomentsListener.cpp
+    struct Commands;
+
+    // FNV-1a, usable in constant expressions to place commands at compile time
+    static constexpr uint32_t Hash(const char* name, uint32_t hash = 2166136261u) {
+        return *name == '\0' ? hash
+            : Hash(name + 1, (hash ^ static_cast<uint8_t>(*name)) * 16777619u);
+    }
+    static uint32_t Hash(const std::string& name);
+
+    static const Command* FindCommand(const std::string& name);
+    static bool Validate(const Command& command, const Json& json);
+    static bool IsOneOf(const std::string& value, const char* values);
 
 private:
     MomentsService* mService;
+
+    // handler time per command, in the order of the command table
+    std::vector<Histogram*> mCommandTimes;
+    Counter* mDropped;
+    Counter* mRejected;
+    Counter* mInvalid;
+
+    struct Queued {
+        int mCount;
+        bool mNotified;
+    };
+
+    // queued and running messages per friend, the owner is not counted
+    std::mutex mQueuedMutex;
+    std::unordered_map<std::string, Queued> mQueued;
 };
 
 }
@@ -2,9 +2,21 @@
 #include "MomentsService.h"
 #include "MomentsListener.h"
 #include "ghc-filesystem.hpp"
+#include "Log.h"
+#include <map>
+#include <sstream>
+#include <limits>
+#include <cstdlib>
+#include <algorithm>
 
 namespace elastos {
 
+static int64_t SteadyMilliseconds()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 extern "C" {
 
 void* CreateService(const char* path)
@@ -24,58 +36,244 @@ void DestroyService(void* service)
 }
 
 MomentsService::MomentsService(const std::string& path)
-    : mPath(path)
-    , mStopThread(true)
+    : mHost(ServiceHost::Acquire())
+    , mPath(path)
+    , mMetrics(std::make_shared<Metrics>())
+    , mSenderQueueLimit(SENDER_QUEUED_MAX)
+    , mPushDeferred(false)
+    , mActive(false)
+    , mLastUsed(0)
+    , mSettingsLoaded(false)
+    , mIdleTimeout(TENANT_IDLE_TIMEOUT)
+    , mPushActive(false)
+    , mPushScheduled(false)
+    , mPushWindow(PUSH_COALESCE_WINDOW)
 {
+    mPath.append("/Moments");
+
+    // keys on the shared workers are prefixed per tenant
+    std::string prefix = mPath + "#";
+    mTasks = std::make_shared<TaskGroup>(mHost->GetWorkerPool(), prefix);
+    mPushTasks = std::make_shared<TaskGroup>(mHost->GetWorkerPool(), prefix + "push#");
+    mTasks->Open();
+
+    // the data directory is made on a worker while the connector is set up
+    if (!mTasks->Post("init", [this] { PrepareStorage(); })) {
+        PrepareStorage();
+    }
+
     mConnector = std::make_shared<Connector>(MOMENTS_SERVICE_NAME);
     auto listener = std::shared_ptr<PeerListener::MessageListener>(new MomentsListener(this));
     mConnector->SetMessageListener(listener);
+    mSender = std::make_shared<MessageSender>(mConnector,
+        std::make_shared<TaskGroup>(mHost->GetWorkerPool(), prefix + "send#"),
+        mMetrics->GetHistogram("send.push"));
+    mResponseTime = mMetrics->GetHistogram("send.response");
+    mPushTime = mMetrics->GetHistogram("push.round");
+    mPushMessages = mMetrics->GetCounter("push.messages");
 
     std::shared_ptr<ElaphantContact::UserInfo> userInfo = mConnector->GetUserInfo();
     userInfo->getHumanCode(mUserCode);
-    mPath.append("/Moments");
 
-    std::error_code stdErrCode;
-    bool ret = ghc::filesystem::create_directories(mPath, stdErrCode);
-    if(ret == false || stdErrCode.value() != 0) {
-        int errCode = ErrCode::StdSystemErrorIndex - stdErrCode.value();
-        auto errMsg = ErrCode::ToString(errCode);
-        printf("MomentsService Failed to set local data dir, errcode: %s", errMsg.c_str());
+    const char* profileName = getenv(STORAGE_PROFILE_ENV);
+    auto profile = DatabaseHelper::StorageProfile::FromName(profileName != nullptr ? profileName : "");
+    mDatabase = mHost->GetDatabases().Open(mPath, profile, mMetrics);
+    mCursorStore = std::make_shared<CursorStore>(mDatabase);
+    mResponseCache = std::make_shared<ResponseCache>();
+    mRateLimiter = std::make_shared<RateLimiter>();
+
+    const char* idleTimeout = getenv(IDLE_TIMEOUT_ENV);
+    if (idleTimeout != nullptr) {
+        SetIdleTimeout(std::atoi(idleTimeout) * 1000);
+    }
+
+    mMetrics->SetGauge("sender.queue", [this] { return static_cast<int64_t>(mSender->Size()); });
+    mMetrics->SetGauge("workers.queue", [this] { return static_cast<int64_t>(mTasks->Size()); });
+    mMetrics->SetGauge("friends.online", [this] {
+        std::unique_lock<std::mutex> _lock(mListMutex);
+        return static_cast<int64_t>(mOnlineFriendList.size());
+    });
+    mMetrics->SetGauge("tenant.active", [this] { return static_cast<int64_t>(mActive.load()); });
+    mMetrics->SetGauge("push.inflight", [this] {
+        std::unique_lock<std::mutex> _lock(mPushMutex);
+        return static_cast<int64_t>(mPushingFriends.size());
+    });
+}
+
+MomentsService::~MomentsService()
+{
+    // handlers, pushes and sends may still be running against the service
+    mTasks->Close();
+    StopPushing();
+    mMetrics->DumpToFile(mPath + "/" STATS_FILE);
+}
+
+void MomentsService::Activate()
+{
+    Touch();
+
+    // CheckIdle may be deactivating, mActive is only trusted under the lock
+    std::unique_lock<std::mutex> lk(mActiveMutex);
+    if (mActive) return;
+    if (!mSettingsLoaded) {
+        LoadSettings();
+        mSettingsLoaded = true;
+    }
+    mActive = true;
+    auto timeout = mIdleTimeout;
+    lk.unlock();
+
+    LOGI(LOG_SERVICE, "MomentsService %s active", mPath.c_str());
+    ScheduleIdleCheck(timeout.count() > 0 ? timeout : std::chrono::milliseconds(TENANT_IDLE_TIMEOUT));
+}
+
+void MomentsService::Touch()
+{
+    mLastUsed = SteadyMilliseconds();
+}
+
+// once per tenant, on a worker during construction or by the first
+// activation if that comes first
+void MomentsService::PrepareStorage()
+{
+    std::call_once(mStorageOnce, [this] {
+        std::error_code stdErrCode;
+        ghc::filesystem::create_directories(mPath, stdErrCode);
+        if (stdErrCode.value() != 0) {
+            int errCode = ErrCode::StdSystemErrorIndex - stdErrCode.value();
+            auto errMsg = ErrCode::ToString(errCode);
+            LOGE(LOG_SERVICE, "MomentsService Failed to set local data dir, errcode: %s", errMsg.c_str());
+        }
+    });
+}
+
+// mActiveMutex held
+void MomentsService::LoadSettings()
+{
+    PrepareStorage();
+
+    // opening the database also warms its timeline cache
+    auto dbHelper = mDatabase->Get();
+    std::string owner = dbHelper->GetOwner();
+    mPrivate = dbHelper->GetPrivate();
+    {
+        std::unique_lock<std::mutex> ownerLock(mOwnerMutex);
+        mOwner = owner;
     }
 
-    mDbHelper = std::make_shared<DatabaseHelper>(mPath);
-    mOwner = mDbHelper->GetOwner();
-    mPrivate = mDbHelper->GetPrivate();
+    LOGI(LOG_SERVICE, "MomentsService owner %s isPirvate %d", owner.c_str(), mPrivate.load());
 
-    printf("MomentsService owner %s isPirvate %d\n", mOwner.c_str(), mPrivate);
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    bool online = mPushActive;
+    lk.unlock();
+    if (owner.empty() && online) {
+        FindOwner();
+    }
+}
 
+// mActiveMutex held, the friend list is only read once the user is
+// online and the settings are loaded
+void MomentsService::FindOwner()
+{
     const auto& friendList = mConnector->ListFriendInfo();
-    if (mOwner.empty() && !friendList.empty()) {
-        auto first = friendList[0];
-        std::string friendCode;
-        first->getHumanCode(friendCode);
-        if (IsDid(friendCode)) {
-            SetOwner(friendCode);
+    if (friendList.empty()) {
+        return;
+    }
+
+    std::string friendCode;
+    friendList[0]->getHumanCode(friendCode);
+    if (IsDid(friendCode)) {
+        {
+            std::unique_lock<std::mutex> ownerLock(mOwnerMutex);
+            mOwner = friendCode;
         }
+        mDatabase->Get()->SetOwner(friendCode);
     }
 }
 
+void MomentsService::ScheduleIdleCheck(std::chrono::milliseconds delay)
+{
+    mHost->GetScheduler().Schedule(delay, mTasks, "idle", [this] {
+        CheckIdle();
+    });
+}
+
+// runs as an mTasks task, requests activate under mActiveMutex so none
+// starts while the tenant is checked and released
+void MomentsService::CheckIdle()
+{
+    std::unique_lock<std::mutex> lk(mActiveMutex);
+    auto timeout = mIdleTimeout;
+    if (timeout.count() <= 0) {
+        lk.unlock();
+        ScheduleIdleCheck(std::chrono::milliseconds(TENANT_IDLE_TIMEOUT));
+        return;
+    }
+
+    auto idle = std::chrono::milliseconds(SteadyMilliseconds() - mLastUsed);
+    if (idle < timeout) {
+        lk.unlock();
+        ScheduleIdleCheck(timeout - idle);
+        return;
+    }
+
+    // quiet, but pushes or requests may still be on their way; this check
+    // is one of the running tasks
+    bool busy = mTasks->Size() > 0 || mTasks->Running() > 1 || mSender->Size() > 0;
+    {
+        std::unique_lock<std::mutex> pushLock(mPushMutex);
+        busy = busy || !mPushingFriends.empty();
+    }
+    {
+        std::unique_lock<std::mutex> stateLock(mPushStateMutex);
+        busy = busy || mPushScheduled;
+    }
+    if (busy || !Deactivate()) {
+        lk.unlock();
+        ScheduleIdleCheck(timeout);
+    }
+}
+
+// mActiveMutex held, false when something still holds the database and
+// the tenant stays active
+bool MomentsService::Deactivate()
+{
+    // cursors are written back before the store lets go of them
+    mCursorStore->Flush();
+    if (!mCursorStore->Unload() || !mDatabase->Release()) {
+        LOGD(LOG_SERVICE, "MomentsService %s still in use", mPath.c_str());
+        return false;
+    }
+
+    mActive = false;
+    mResponseCache->InvalidateAll();
+
+    LOGI(LOG_SERVICE, "MomentsService %s idle, released", mPath.c_str());
+    return true;
+}
+
 int MomentsService::SetOwner(const std::string& owner)
 {
-    mOwner = owner;
-    return mDbHelper->SetOwner(mOwner);
+    Activate();
+    {
+        std::unique_lock<std::mutex> _lock(mOwnerMutex);
+        mOwner = owner;
+    }
+    return mDatabase->Get()->SetOwner(owner);
 }
 
 std::string MomentsService::GetOwner()
 {
+    std::unique_lock<std::mutex> _lock(mOwnerMutex);
     return mOwner;
 }
 
 int MomentsService::SetPrivate(bool priv)
 {
+    Activate();
     mPrivate = priv;
 
-    return mDbHelper->SetPrivate(mPrivate);
+    return mDatabase->Get()->SetPrivate(mPrivate);
 }
 
 bool MomentsService::IsPrivate()
@@ -86,9 +284,11 @@ bool MomentsService::IsPrivate()
 int MomentsService::Add(int type, const std::string& content,
             long time, const std::string& files, const std::string& access)
 {
-    int ret = mDbHelper->InsertData(type, content, time, files, access);
+    Activate();
+    int ret = mDatabase->Get()->InsertData(type, content, time, files, access);
     if (ret > 0) {
-        printf("insert to db id %d\n", ret);
+        LOGD(LOG_SERVICE, "insert to db id %d", ret);
+        mResponseCache->InvalidatePages();
         NotifyPushMessage();
     }
 
@@ -97,12 +297,24 @@ int MomentsService::Add(int type, const std::string& content,
 
 int MomentsService::Remove(int id)
 {
-    return mDbHelper->RemoveData(id);
+    Activate();
+    int ret = mDatabase->Get()->RemoveData(id);
+    if (ret == 0) {
+        mResponseCache->InvalidateData(id);
+    }
+
+    return ret;
 }
 
 int MomentsService::Clear()
 {
-    return mDbHelper->ClearData();
+    Activate();
+    int ret = mDatabase->Get()->ClearData();
+    if (ret == 0) {
+        mResponseCache->InvalidateAll();
+    }
+
+    return ret;
 }
 
 int MomentsService::Comment(const std::string& friendCode, const std::string& content)
@@ -110,10 +322,57 @@ int MomentsService::Comment(const std::string& friendCode, const std::string& co
     return -1;
 }
 
+void MomentsService::SetPushWindow(int milliseconds)
+{
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    mPushWindow = std::chrono::milliseconds(std::max(0, milliseconds));
+}
+
+void MomentsService::SetIdleTimeout(int milliseconds)
+{
+    std::unique_lock<std::mutex> lk(mActiveMutex);
+    mIdleTimeout = std::chrono::milliseconds(std::max(0, milliseconds));
+}
+
+bool MomentsService::IsActive()
+{
+    return mActive;
+}
+
+void MomentsService::SetRateLimit(RequestClass requestClass, double perSecond, double burst)
+{
+    mRateLimiter->SetBudget(requestClass, perSecond, burst);
+}
+
+void MomentsService::SetSenderQueueLimit(int limit)
+{
+    mSenderQueueLimit = std::max(0, limit);
+}
+
+int MomentsService::SetFormat(const std::string& friendCode, WireFormat format)
+{
+    std::unique_lock<std::mutex> _lock(mFormatMutex);
+    if (format == WireFormat::Json) {
+        mFormats.erase(friendCode);
+    }
+    else {
+        mFormats[friendCode] = format;
+    }
+
+    return 0;
+}
+
+WireFormat MomentsService::GetFormat(const std::string& friendCode)
+{
+    std::unique_lock<std::mutex> _lock(mFormatMutex);
+    auto it = mFormats.find(friendCode);
+    return it != mFormats.end() ? it->second : WireFormat::Json;
+}
+
 int MomentsService::UpdateFriendList(const std::string& friendCode, const FriendInfo::Status& status)
 {
-    if (!friendCode.compare(mOwner)) {
-        printf("MomentsService owner status changed\n");
+    if (!friendCode.compare(GetOwner())) {
+        LOGI(LOG_SERVICE, "MomentsService owner status changed");
         return 0;
     }
 
@@ -133,6 +392,9 @@ int MomentsService::UpdateFriendList(const std::string& friendCode, const Friend
                 break;
             }
         }
+        // negotiated again on the next connection, the rate limit buckets
+        // are kept and swept once refilled
+        SetFormat(friendCode, WireFormat::Json);
     }
 
     return 0;
@@ -141,71 +403,265 @@ int MomentsService::UpdateFriendList(const std::string& friendCode, const Friend
 void MomentsService::UserStatusChanged(const FriendInfo::Status& status)
 {
     if (status == FriendInfo::Status::Online) {
-        StartMessageThread();
+        StartPushing();
+
+        // the owner lookup writes the database, never on the carrier thread
+        mTasks->Post("init", [this] {
+            std::unique_lock<std::mutex> lk(mActiveMutex);
+            if (mSettingsLoaded && GetOwner().empty()) {
+                lk.unlock();
+                Activate();
+                lk.lock();
+                if (GetOwner().empty()) FindOwner();
+            }
+        });
     }
     else {
-        StopMessageThread();
+        StopPushing();
     }
 }
 
-void MomentsService::StartMessageThread()
+void MomentsService::StartPushing()
 {
-    if (mMessageThread.get() != nullptr) return;
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    if (mPushActive) return;
+    mPushActive = true;
+    lk.unlock();
 
-    mStopThread = false;
-    mMessageThread = std::make_shared<std::thread>(MomentsService::ThreadFun, this);
+    LOGI(LOG_PUSH, "Moments service start pushing.");
+    mSender->Start();
+    mPushTasks->Open();
+
+    // friends may already be online
+    NotifyPushMessage();
 }
 
-void MomentsService::StopMessageThread()
+void MomentsService::StopPushing()
 {
-    mStopThread = true;
-    mMessageThread->join();
-    mMessageThread.reset();
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    if (!mPushActive) return;
+    mPushActive = false;
+    mPushScheduled = false;
+    lk.unlock();
+
+    // waits for a running round, then for the sends it queued
+    mPushTasks->Close();
+    mSender->Stop();
+    mCursorStore->Flush();
+    LOGI(LOG_PUSH, "Moments service stop pushing.");
+
+    std::unique_lock<std::mutex> pushLock(mPushMutex);
+    mPushingFriends.clear();
+    mPushDeferred = false;
 }
 
 void MomentsService::NotifyPushMessage()
 {
-    std::unique_lock<std::mutex> lk(mCvMutex);
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    auto window = mPushWindow;
+    lk.unlock();
+
+    // let a burst of notifications settle so they cost one push round
+    SchedulePushRound(window);
+}
+
+void MomentsService::SchedulePushRound(std::chrono::milliseconds delay)
+{
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    if (!mPushActive || mPushScheduled) return;
+    mPushScheduled = true;
     lk.unlock();
-    mCv.notify_one();
+
+    mHost->GetScheduler().Schedule(delay, mPushTasks, "round", [this] {
+        PushRound();
+    });
 }
 
-void MomentsService::PushMoments(std::shared_ptr<ElaphantContact::FriendInfo>& friendInfo)
+void MomentsService::PushRound()
 {
-    std::string humanCode;
-    friendInfo->getHumanCode(humanCode);
-    printf("MomentsService push moments to %s\n", humanCode.c_str());
+    std::unique_lock<std::mutex> lk(mPushStateMutex);
+    mPushScheduled = false;
+    lk.unlock();
+
+    Activate();
+    LOGD(LOG_PUSH, "Moments service push round");
+    PushMoments();
+}
+
+int MomentsService::GetPushCursor(const std::string& humanCode,
+                                  std::shared_ptr<ElaphantContact::FriendInfo>& friendInfo,
+                                  DatabaseHelper::Cursor& cursor)
+{
+    cursor = DatabaseHelper::Cursor();
+    bool found;
+    int ret = mCursorStore->Get(humanCode, cursor, &found);
+    if (ret != 0 || found) {
+        return ret;
+    }
 
-    long time = 0;
+    // cursors used to be kept in the Addition field, migrate them once.
+    // Everything up to and including that time was delivered.
     std::string addition;
     friendInfo->getHumanInfo(ElaphantContact::HumanInfo::Item::Addition, addition);
     if (!addition.empty()) {
-        time = std::stol(addition);
+        try {
+            cursor.mTime = std::stol(addition);
+            cursor.mId = std::numeric_limits<int>::max();
+        } catch (const std::exception& e) {
+            LOGW(LOG_PUSH, "MomentsService invalid addition cursor %s", addition.c_str());
+        }
     }
 
-    long lastTime;
-    std::stringstream ss;
-    int ret = mDbHelper->GetData(time, ss, &lastTime);
-    if (ret != SQLITE_OK) {
-        printf("get data error \n");
+    return mCursorStore->Set(humanCode, cursor);
+}
+
+void MomentsService::PushMoments()
+{
+    ScopedTimer timer(mPushTime);
+
+    std::vector<std::shared_ptr<ElaphantContact::FriendInfo>> friendList;
+    {
+        // snapshot, queries and sends run without blocking UpdateFriendList
+        std::unique_lock<std::mutex> _lock(mListMutex);
+        friendList = mOnlineFriendList;
+    }
+    if (friendList.size() == 0) {
         return;
     }
 
-    std::string record = ss.str();
-    if (record.size() <= 5) {
-        printf("no new moment\n");
+    // friends sharing a cursor and a format get the same payload, query and
+    // serialize once per group
+    std::map<std::pair<WireFormat, DatabaseHelper::Cursor>,
+             std::vector<std::shared_ptr<ElaphantContact::FriendInfo>>> groups;
+    std::string owner = GetOwner();
+    bool retry = false;
+    {
+        std::unique_lock<std::mutex> _lock(mPushMutex);
+        for (auto& friendItem : friendList) {
+            std::string humanCode;
+            friendItem->getHumanCode(humanCode);
+            // online before the settings naming the owner were loaded
+            if (!humanCode.compare(owner)) continue;
+            if (mPushingFriends.count(humanCode) > 0) {
+                mPushDeferred = true;
+                continue;
+            }
+            DatabaseHelper::Cursor cursor;
+            if (GetPushCursor(humanCode, friendItem, cursor) != 0) {
+                // the delivered position is unknown, pushing now would repeat moments
+                retry = true;
+                continue;
+            }
+            groups[std::make_pair(GetFormat(humanCode), cursor)].push_back(friendItem);
+        }
+    }
+    if (retry) {
+        LOGW(LOG_PUSH, "MomentsService cursors unavailable, retry in %d ms", PUSH_RETRY_DELAY);
+        SchedulePushRound(std::chrono::milliseconds(PUSH_RETRY_DELAY));
+    }
+
+    LOGD(LOG_PUSH, "MomentsService push moments to %zu friends in %zu groups", friendList.size(), groups.size());
+    for (auto& group : groups) {
+        PushMoments(group.first.second, group.first.first, group.second);
+    }
+}
+
+void MomentsService::PushMoments(const DatabaseHelper::Cursor& cursor, WireFormat format,
+                                 std::vector<std::shared_ptr<ElaphantContact::FriendInfo>>& friends)
+{
+    auto dbHelper = mDatabase->Get();
+    DatabaseHelper::Cursor from = cursor;
+    bool more = true;
+    for (int chunk = 0; more && chunk < PUSH_CHUNKS_PER_ROUND; chunk++) {
+        // the envelope is written straight from the query rows
+        DatabaseHelper::Cursor last = from;
+        int ret;
+        if (format == WireFormat::Binary) {
+            mPushBinaryWriter.Reset();
+            mPushBinaryWriter.Header(BINARY_PUSH_DATA);
+            BinaryResultWriter writer(mPushBinaryWriter);
+            ret = dbHelper->GetDelta(from, DELTA_LIMIT, writer, &last, &more);
+        }
+        else {
+            mPushWriter.Reset();
+            mPushWriter.BeginObject();
+            mPushWriter.Key("command").String("pushData");
+            mPushWriter.Key("type").Int(0);
+            mPushWriter.Key("content");
+            JsonResultWriter writer(mPushWriter);
+            ret = dbHelper->GetDelta(from, DELTA_LIMIT, writer, &last, &more);
+        }
+        if (ret != SQLITE_OK) {
+            LOGE(LOG_PUSH, "get data error %d", ret);
+            return;
+        }
+
+        if (last == from) {
+            LOGD(LOG_PUSH, "no new moment");
+            return;
+        }
+
+        std::shared_ptr<const std::string> message;
+        if (format == WireFormat::Binary) {
+            mPushBinaryWriter.Byte(more ? 1 : 0);
+            message = std::make_shared<const std::string>(mPushBinaryWriter.str());
+        }
+        else {
+            mPushWriter.Key("more").Bool(more);
+            mPushWriter.EndObject();
+            message = std::make_shared<const std::string>(mPushWriter.str());
+        }
+
+        for (auto& friendInfo : friends) {
+            std::string humanCode;
+            friendInfo->getHumanCode(humanCode);
+            LOGD(LOG_PUSH, "MomentsService push moments to %s", humanCode.c_str());
+
+            {
+                std::unique_lock<std::mutex> _lock(mPushMutex);
+                mPushingFriends[humanCode]++;
+            }
+            mPushMessages->Add();
+
+            mSender->Post(humanCode, message, format, [this, humanCode, from, last](int result) {
+                if (result == 0) {
+                    mCursorStore->Advance(humanCode, from, last);
+                }
+                PushFinished(humanCode);
+            });
+        }
+
+        from = last;
+    }
+
+    if (more) {
+        // not caught up yet, continue once this round has been sent
+        std::unique_lock<std::mutex> _lock(mPushMutex);
+        mPushDeferred = true;
+    }
+}
+
+void MomentsService::PushFinished(const std::string& humanCode)
+{
+    std::unique_lock<std::mutex> _lock(mPushMutex);
+    auto it = mPushingFriends.find(humanCode);
+    if (it != mPushingFriends.end() && --it->second <= 0) {
+        mPushingFriends.erase(it);
+    }
+    if (!mPushingFriends.empty()) {
         return;
     }
 
-    Json content;
-    content["command"] = "pushData";
-    content["type"] = 0;
-    content["content"] = Json::parse(record);
+    bool deferred = mPushDeferred;
+    mPushDeferred = false;
+    _lock.unlock();
 
-    ret = mConnector->SendMessage(humanCode, content.dump());
-    if (ret != 0) return;
+    // the round is fully sent, write its cursors in one transaction
+    mCursorStore->Flush();
 
-    friendInfo->setHumanInfo(ElaphantContact::HumanInfo::Item::Addition, std::to_string(lastTime));
+    if (deferred) {
+        NotifyPushMessage();
+    }
 }
 
 void MomentsService::SendSetting(const std::string& type)
@@ -214,48 +670,149 @@ void MomentsService::SendSetting(const std::string& type)
         Json content;
         content["command"] = "getSetting";
         content["type"] = type;
-        content["value"] = mPrivate;
-        mConnector->SendMessage(mOwner, content.dump());
+        content["value"] = mPrivate.load();
+        SendMessage(GetOwner(), content.dump());
     }
     else {
-        printf("MomentsService do not support this type: %s\n", type.c_str());
+        LOGW(LOG_SERVICE, "MomentsService do not support this type: %s", type.c_str());
     }
 }
 
 void MomentsService::SendData(const std::string& friendCode, int id)
 {
     if (id < 0) return;
-    auto moment = mDbHelper->GetData(id);
-    if (moment == nullptr) {
-        printf("MomentsService data id %d not found\n", id);
-        return;
-    }
 
-    Json content;
-    content["command"] = "getData";
-    content["content"] = moment->toJson();
+    WireFormat format = GetFormat(friendCode);
+    uint64_t generation;
+    auto payload = mResponseCache->GetData(id, format, &generation);
+    if (payload == nullptr) {
+        JsonWriter json;
+        BinaryWriter binary;
+        bool found = false;
+        int ret;
+        if (format == WireFormat::Binary) {
+            binary.Header(BINARY_GET_DATA);
+            BinaryResultWriter writer(binary);
+            ret = mDatabase->Get()->GetData(id, writer, &found);
+        }
+        else {
+            json.BeginObject();
+            json.Key("command").String("getData");
+            json.Key("content");
+            JsonResultWriter writer(json);
+            ret = mDatabase->Get()->GetData(id, writer, &found);
+            json.EndObject();
+        }
+        if (ret != SQLITE_OK || !found) {
+            LOGD(LOG_SERVICE, "MomentsService data id %d not found", id);
+            return;
+        }
+
+        payload = std::make_shared<const std::string>(
+            format == WireFormat::Binary ? binary.Detach() : json.Detach());
+        mResponseCache->PutData(id, format, payload, generation);
+    }
 
-    mConnector->SendMessage(friendCode, content.dump());
+    SendMessage(friendCode, *payload, format);
 }
 
-void MomentsService::SendDataList(const std::string& friendCode, long time)
+void MomentsService::SendDataList(const std::string& friendCode, long time, int size)
 {
-    Json moments = Json::array();
-    int ret = mDbHelper->GetData(time, moments);
-    if (ret != SQLITE_OK) {
-        printf("MomentsService GetData failed %d\n", ret);
+    WireFormat format = GetFormat(friendCode);
+    std::stringstream key;
+    key << "getDataList:" << static_cast<int>(format) << ":" << std::max(time, 0L) << ":" << size;
+
+    // followers asking together after a publish share one query
+    auto payload = mResponseCache->GetPage(key.str(), [this, format, time, size]() -> ResponseCache::Payload {
+        JsonWriter json;
+        BinaryWriter binary;
+        int count = 0;
+        int ret;
+        if (format == WireFormat::Binary) {
+            binary.Header(BINARY_GET_DATA_LIST);
+            BinaryResultWriter writer(binary);
+            ret = mDatabase->Get()->GetData(time, size, writer, &count);
+        }
+        else {
+            json.BeginObject();
+            json.Key("command").String("getDataList");
+            json.Key("content");
+            JsonResultWriter writer(json);
+            ret = mDatabase->Get()->GetData(time, size, writer, &count);
+            json.EndObject();
+        }
+        if (ret != SQLITE_OK) {
+            LOGE(LOG_SERVICE, "MomentsService GetData failed %d", ret);
+            return nullptr;
+        }
+
+        // an empty payload caches "no new data"
+        std::string message;
+        if (count > 0) {
+            message = format == WireFormat::Binary ? binary.Detach() : json.Detach();
+        }
+        return std::make_shared<const std::string>(std::move(message));
+    });
+
+    if (payload == nullptr) {
         return;
     }
-    if (moments.size() == 0) {
-        printf("MomentsService GetData no new data\n");
+    if (payload->empty()) {
+        LOGD(LOG_SERVICE, "MomentsService GetData no new data");
         return;
     }
 
-    Json content;
-    content["command"] = "getDataList";
-    content["content"] = moments;
+    SendMessage(friendCode, *payload, format);
+}
+
+void MomentsService::SendDataPage(const std::string& friendCode, long time, int id,
+                                  DatabaseHelper::PageDirection pageDirection, int size)
+{
+    // the cache key and the response name the direction, never the request
+    const char* direction = pageDirection == DatabaseHelper::PageDirection::Newer ? "newer" : "older";
+
+    WireFormat format = GetFormat(friendCode);
+    std::stringstream key;
+    key << "getDataPage:" << static_cast<int>(format) << ":" << direction << ":"
+        << std::max(time, 0L) << ":" << id << ":" << size;
+
+    auto payload = mResponseCache->GetPage(key.str(),
+            [this, format, time, id, pageDirection, direction, size]() -> ResponseCache::Payload {
+        JsonWriter json;
+        BinaryWriter binary;
+        bool more = false;
+        int ret;
+        if (format == WireFormat::Binary) {
+            binary.Header(BINARY_GET_DATA_PAGE);
+            binary.Byte(pageDirection == DatabaseHelper::PageDirection::Newer ? 1 : 0);
+            BinaryResultWriter writer(binary);
+            ret = mDatabase->Get()->GetDataPage(time, id, pageDirection, size, writer, &more);
+            binary.Byte(more ? 1 : 0);
+        }
+        else {
+            json.BeginObject();
+            json.Key("command").String("getDataPage");
+            json.Key("direction").String(direction);
+            json.Key("content");
+            JsonResultWriter writer(json);
+            ret = mDatabase->Get()->GetDataPage(time, id, pageDirection, size, writer, &more);
+            json.Key("more").Bool(more);
+            json.EndObject();
+        }
+        if (ret != SQLITE_OK) {
+            LOGE(LOG_SERVICE, "MomentsService GetDataPage failed %d", ret);
+            return nullptr;
+        }
 
-    mConnector->SendMessage(friendCode, content.dump());
+        return std::make_shared<const std::string>(
+            format == WireFormat::Binary ? binary.Detach() : json.Detach());
+    });
+
+    if (payload == nullptr) {
+        return;
+    }
+
+    SendMessage(friendCode, *payload, format);
 }
 
 bool MomentsService::IsDid(const std::string& friendCode)
@@ -264,6 +821,13 @@ bool MomentsService::IsDid(const std::string& friendCode)
     else return false;
 }
 
+int MomentsService::SendMessage(const std::string& friendCode, const std::string& message,
+                                WireFormat format)
+{
+    ScopedTimer timer(mResponseTime);
+    return MessageSender::Send(*mConnector, friendCode, format, message);
+}
+
 void MomentsService::PublishResponse(long time, int result)
 {
     Json content;
@@ -271,7 +835,7 @@ void MomentsService::PublishResponse(long time, int result)
     content["time"] = time;
     content["result"] = result;
 
-    mConnector->SendMessage(mOwner, content.dump());
+    SendMessage(GetOwner(), content.dump());
 }
 
 void MomentsService::DeleteResponse(int id, int result)
@@ -281,7 +845,7 @@ void MomentsService::DeleteResponse(int id, int result)
     content["id"] = id;
     content["result"] = result;
 
-    mConnector->SendMessage(mOwner, content.dump());
+    SendMessage(GetOwner(), content.dump());
 }
 
 void MomentsService::ClearResponse(int result)
@@ -290,7 +854,7 @@ void MomentsService::ClearResponse(int result)
     content["command"] = "clear";
     content["result"] = result;
 
-    mConnector->SendMessage(mOwner, content.dump());
+    SendMessage(GetOwner(), content.dump());
 }
 
 void MomentsService::SettingResponse(const std::string& type, int result)
@@ -298,10 +862,42 @@ void MomentsService::SettingResponse(const std::string& type, int result)
     Json content;
     content["command"] = "setting";
     content["type"] = type;
-    content["value"] = mPrivate;
+    content["value"] = mPrivate.load();
     content["result"] = result;
 
-    mConnector->SendMessage(mOwner, content.dump());
+    SendMessage(GetOwner(), content.dump());
+}
+
+void MomentsService::FormatResponse(const std::string& friendCode, const std::string& format, int result)
+{
+    Json content;
+    content["command"] = "setFormat";
+    content["format"] = format;
+    content["result"] = result;
+
+    SendMessage(friendCode, content.dump());
+}
+
+void MomentsService::SendStats(bool dumpFile)
+{
+    Json content;
+    content["command"] = "getStats";
+    content["content"] = mMetrics->ToJson();
+    if (dumpFile) {
+        content["result"] = mMetrics->DumpToFile(mPath + "/" STATS_FILE);
+    }
+
+    SendMessage(GetOwner(), content.dump());
+}
+
+void MomentsService::BusyResponse(const std::string& friendCode, const std::string& command, long retryAfter)
+{
+    Json content;
+    content["command"] = "busy";
+    content["request"] = command;
+    content["retryAfter"] = retryAfter;
+
+    SendMessage(friendCode, content.dump());
 }
 
 void MomentsService::SendFollowList(const std::string& friendCode)
@@ -311,12 +907,13 @@ void MomentsService::SendFollowList(const std::string& friendCode)
     Json content;
     content["command"] = "getFollowList";
 
+    std::string owner = GetOwner();
     Json list = Json::array();
     int index = 0;
     for (auto friendInfo : friendList) {
         std::string humanCode;
         friendInfo->getHumanCode(humanCode);
-        if (humanCode.compare(mOwner)) {
+        if (humanCode.compare(owner)) {
             list[index] = humanCode;
             index++;
         }
@@ -324,7 +921,7 @@ void MomentsService::SendFollowList(const std::string& friendCode)
 
     content["content"] = list;
 
-    mConnector->SendMessage(mOwner, content.dump());
+    SendMessage(owner, content.dump());
 }
 
 void MomentsService::SendNewFollow(const std::string& friendCode)
@@ -332,30 +929,7 @@ void MomentsService::SendNewFollow(const std::string& friendCode)
     Json json;
     json["command"] = "newFollow";
     json["friendCode"] = friendCode;
-    mConnector->SendMessage(mOwner, json.dump());
-}
-
-void MomentsService::ThreadFun(MomentsService* service)
-{
-    printf("Moments service start message thread.\n");
-
-    while (!service->mStopThread) {
-        printf("Momtents service message thread wait\n");
-        std::unique_lock<std::mutex> lk(service->mCvMutex);
-        service->mCv.wait(lk);
-
-        printf("Momtents service message thread aweak\n");
-        std::unique_lock<std::mutex> _lock(service->mListMutex);
-        if (service->mOnlineFriendList.size() == 0) {
-            continue;
-        }
-
-        for (auto& friendItem : service->mOnlineFriendList) {
-            service->PushMoments(friendItem);
-        }
-    }
-
-    printf("Moments service stop message thread.\n");
+    SendMessage(GetOwner(), json.dump());
 }
 
 }
@@ -4,20 +4,58 @@
 
 #include <string>
 #include <memory>
-#include <thread>
+#include <chrono>
 #include "Connector.h"
 #include "DatabaseHelper.h"
-#include <condition_variable>
+#include "MessageSender.h"
+#include "CursorStore.h"
+#include "ResponseCache.h"
+#include "ResultWriter.h"
+#include "WorkerPool.h"
+#include "ServiceHost.h"
+#include "RateLimiter.h"
+#include "Metrics.h"
+#include <map>
+#include <mutex>
+#include <atomic>
 
 #define MOMENTS_SERVICE_NAME    "moments"
 
+// environment variable selecting DatabaseHelper::StorageProfile by name
+#define STORAGE_PROFILE_ENV     "MOMENTS_STORAGE_PROFILE"
+
+// notifications arriving within this window are merged into one push round
+#define PUSH_COALESCE_WINDOW    200
+
+// pushData deltas carry at most DELTA_LIMIT entries, a round sends up to
+// this many per cursor group and schedules another round for the rest
+#define PUSH_CHUNKS_PER_ROUND   4
+
+// milliseconds before a push round is retried when the delivery cursors
+// could not be loaded
+#define PUSH_RETRY_DELAY        5000
+
+// messages a friend may have waiting on the shared workers, the rest are
+// rejected on the carrier thread before they take a queue slot
+#define SENDER_QUEUED_MAX       8
+// milliseconds a friend is told to wait when its queue is full
+#define SENDER_RETRY_AFTER      1000
+
+// a tenant without traffic for this long releases its database and caches,
+// IDLE_TIMEOUT_ENV overrides it in seconds and 0 keeps tenants open
+#define TENANT_IDLE_TIMEOUT     600000
+#define IDLE_TIMEOUT_ENV        "MOMENTS_IDLE_TIMEOUT"
+
+// written to the data directory by getStats and when the service stops
+#define STATS_FILE              "stats.json"
+
 namespace elastos  {
 
 class MomentsService
 {
 public:
     MomentsService(const std::string& path);
-    ~MomentsService() = default;
+    ~MomentsService();
 
     int SetOwner(const std::string& owner);
     std::string GetOwner();
@@ -35,53 +73,149 @@ public:
     // Apis for others
     int Comment(const std::string& friendCode, const std::string& content);
 
+    void SetPushWindow(int milliseconds);
+
+    // applies from the next idle check, 0 disables eviction
+    void SetIdleTimeout(int milliseconds);
+
+    // whether the database and caches are loaded, see Activate
+    bool IsActive();
+
+    // requests a friend may send per second in a class, with burst on top
+    void SetRateLimit(RequestClass requestClass, double perSecond, double burst);
+
+    // messages a friend may have queued before the rest are rejected,
+    // 0 lifts the cap
+    void SetSenderQueueLimit(int limit);
+
+    // format of the responses and pushes sent to a friend, json until the
+    // friend asks for binary with setFormat, reset when it goes offline
+    int SetFormat(const std::string& friendCode, WireFormat format);
+    WireFormat GetFormat(const std::string& friendCode);
+
 private:
+    // loads the tenant on first use after registration or eviction, cheap
+    // when already active. Every request calls it on a worker to stay
+    // active, the carrier thread only calls Touch.
+    void Activate();
+    void Touch();
+    void PrepareStorage();
+    void LoadSettings();
+    void FindOwner();
+
+    void ScheduleIdleCheck(std::chrono::milliseconds delay);
+    void CheckIdle();
+    bool Deactivate();
+
     int UpdateFriendList(const std::string& friendCode, const FriendInfo::Status& status);
 
     void UserStatusChanged(const FriendInfo::Status& status);
 
-    void StartMessageThread();
-    void StopMessageThread();
+    void StartPushing();
+    void StopPushing();
 
     void NotifyPushMessage();
+    void SchedulePushRound(std::chrono::milliseconds delay);
+
+    // a scheduled push round, runs on a host worker
+    void PushRound();
 
-    void PushMoments(std::shared_ptr<ElaphantContact::FriendInfo>& friendInfo);
+    void PushMoments();
+    void PushMoments(const DatabaseHelper::Cursor& cursor, WireFormat format,
+                     std::vector<std::shared_ptr<ElaphantContact::FriendInfo>>& friends);
+    void PushFinished(const std::string& humanCode);
+    // fails when the stored cursors could not be read, the friend is then
+    // skipped for the round
+    int GetPushCursor(const std::string& humanCode,
+                      std::shared_ptr<ElaphantContact::FriendInfo>& friendInfo,
+                      DatabaseHelper::Cursor& cursor);
 
     void SendSetting(const std::string& type);
     void SendData(const std::string& friendCode, int id);
-    void SendDataList(const std::string& friendCode, long time);
+    void SendDataList(const std::string& friendCode, long time, int size);
+    void SendDataPage(const std::string& friendCode, long time, int id,
+                      DatabaseHelper::PageDirection direction, int size);
 
     bool IsDid(const std::string& friendCode);
 
+    // Connector::SendMessage for direct responses, timed as send.response
+    int SendMessage(const std::string& friendCode, const std::string& message,
+                    WireFormat format = WireFormat::Json);
+
     void PublishResponse(long time, int result);
     void DeleteResponse(int id, int result);
     void ClearResponse(int result);
     void SettingResponse(const std::string& type, int result);
+    void FormatResponse(const std::string& friendCode, const std::string& format, int result);
+    void SendStats(bool dumpFile);
+    void BusyResponse(const std::string& friendCode, const std::string& command, long retryAfter);
 
     void SendFollowList(const std::string& friendCode);
     void SendNewFollow(const std::string& friendCode);
 
-    static void ThreadFun(MomentsService* service);
-
 private:
+    // declared first, it has to outlive everything running on it
+    std::shared_ptr<ServiceHost> mHost;
+
     std::string mPath;
-    std::string mOwner;
     std::string mUserCode;
-    bool mPrivate;
+    // written by the event callback and activation, read by the workers,
+    // copy it through GetOwner
+    std::mutex mOwnerMutex;
+    std::string mOwner;
+    // read by the workers and the event callback
+    std::atomic<bool> mPrivate;
+
+    std::shared_ptr<Metrics> mMetrics;
+    Histogram* mResponseTime;
+    Histogram* mPushTime;
+    Counter* mPushMessages;
 
     std::shared_ptr<Connector> mConnector;
-    std::shared_ptr<DatabaseHelper> mDbHelper;
+    // opened on demand, the host closes it while idle
+    std::shared_ptr<DatabaseCache::Handle> mDatabase;
+    std::shared_ptr<MessageSender> mSender;
+    std::shared_ptr<CursorStore> mCursorStore;
+    std::shared_ptr<ResponseCache> mResponseCache;
+
+    // MomentsListener handlers on the host workers, ordered per sender
+    std::shared_ptr<TaskGroup> mTasks;
+    // push rounds, open while the user is online
+    std::shared_ptr<TaskGroup> mPushTasks;
+    std::shared_ptr<RateLimiter> mRateLimiter;
+    std::atomic<int> mSenderQueueLimit;
+
+    // reused by the push rounds for every pushData payload
+    JsonWriter mPushWriter;
+    BinaryWriter mPushBinaryWriter;
+
+    std::mutex mFormatMutex;
+    std::map<std::string, WireFormat> mFormats;
 
     std::mutex mListMutex;
     std::vector<std::shared_ptr<ElaphantContact::FriendInfo>> mOnlineFriendList;
 
-    // condition varialbe wait
-    std::condition_variable mCv;
-    std::mutex mCvMutex;
-
-    std::shared_ptr<std::thread> mMessageThread;
-
-    bool mStopThread;
+    // friends with pushes still queued in mSender and how many, their cursor
+    // is not advanced yet so they are skipped until the sends complete
+    std::mutex mPushMutex;
+    std::map<std::string, int> mPushingFriends;
+    bool mPushDeferred;
+
+    // a registered tenant is inactive until its first request
+    std::mutex mActiveMutex;
+    std::atomic<bool> mActive;
+    // steady clock milliseconds of the last request
+    std::atomic<int64_t> mLastUsed;
+    std::once_flag mStorageOnce;
+    // guarded by mActiveMutex
+    bool mSettingsLoaded;
+    std::chrono::milliseconds mIdleTimeout;
+
+    // guarded by mPushStateMutex
+    std::mutex mPushStateMutex;
+    bool mPushActive;
+    bool mPushScheduled;
+    std::chrono::milliseconds mPushWindow;
 
     friend class MomentsListener;
 };
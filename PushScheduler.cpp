@@ -0,0 +1,102 @@
+
+#include "PushScheduler.h"
+#include "Log.h"
+
+namespace elastos {
+
+PushScheduler::PushScheduler()
+    : mStop(true)
+{
+}
+
+PushScheduler::~PushScheduler()
+{
+    Stop();
+}
+
+void PushScheduler::Start()
+{
+    if (mThread.get() != nullptr) return;
+
+    std::unique_lock<std::mutex> lk(mMutex);
+    mStop = false;
+    lk.unlock();
+
+    mThread = std::make_shared<std::thread>(PushScheduler::ThreadFun, this);
+}
+
+void PushScheduler::Stop()
+{
+    if (mThread.get() == nullptr) return;
+
+    std::unique_lock<std::mutex> lk(mMutex);
+    mStop = true;
+    mEntries.clear();
+    lk.unlock();
+    mCv.notify_one();
+
+    mThread->join();
+    mThread.reset();
+}
+
+void PushScheduler::Schedule(std::chrono::milliseconds delay, const std::shared_ptr<TaskGroup>& group,
+                             const std::string& key, WorkerPool::Task task)
+{
+    Entry entry;
+    entry.mGroup = group;
+    entry.mKey = key;
+    entry.mTask = std::move(task);
+
+    std::unique_lock<std::mutex> lk(mMutex);
+    if (mStop) return;
+
+    auto it = mEntries.emplace(Clock::now() + delay, std::move(entry));
+    bool first = it == mEntries.begin();
+    lk.unlock();
+
+    // only an earlier deadline changes the wait
+    if (first) {
+        mCv.notify_one();
+    }
+}
+
+size_t PushScheduler::Size()
+{
+    std::unique_lock<std::mutex> lk(mMutex);
+    return mEntries.size();
+}
+
+void PushScheduler::ThreadFun(PushScheduler* scheduler)
+{
+    LOGI(LOG_PUSH, "Push scheduler start thread.");
+
+    std::unique_lock<std::mutex> lk(scheduler->mMutex);
+    while (!scheduler->mStop) {
+        if (scheduler->mEntries.empty()) {
+            scheduler->mCv.wait(lk);
+            continue;
+        }
+
+        auto due = scheduler->mEntries.begin()->first;
+        if (Clock::now() < due) {
+            scheduler->mCv.wait_until(lk, due);
+            continue;
+        }
+
+        Entry entry = std::move(scheduler->mEntries.begin()->second);
+        scheduler->mEntries.erase(scheduler->mEntries.begin());
+        lk.unlock();
+
+        auto group = entry.mGroup.lock();
+        if (group.get() != nullptr && !group->Post(entry.mKey, std::move(entry.mTask))) {
+            LOGD(LOG_PUSH, "Push scheduler dropped task %s", entry.mKey.c_str());
+        }
+        group.reset();
+
+        lk.lock();
+    }
+
+    LOGI(LOG_PUSH, "Push scheduler stop thread.");
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef __ELASTOS_PUSH_SCHEDULER_H__
+#define __ELASTOS_PUSH_SCHEDULER_H__
+
+#include <string>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include "WorkerPool.h"
+
+namespace elastos {
+
+// One timer thread for the delayed work of every tenant in a process, such
+// as coalesced push rounds. A due task is handed to its TaskGroup, it never
+// runs on the timer thread, and is dropped when the group has gone away or
+// is closed by then.
+class PushScheduler
+{
+public:
+    PushScheduler();
+    ~PushScheduler();
+
+    void Start();
+    void Stop();
+
+    void Schedule(std::chrono::milliseconds delay, const std::shared_ptr<TaskGroup>& group,
+                  const std::string& key, WorkerPool::Task task);
+
+    size_t Size();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        std::weak_ptr<TaskGroup> mGroup;
+        std::string mKey;
+        WorkerPool::Task mTask;
+    };
+
+    static void ThreadFun(PushScheduler* scheduler);
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::multimap<Clock::time_point, Entry> mEntries;
+    bool mStop;
+
+    std::shared_ptr<std::thread> mThread;
+};
+
+}
+
+#endif //__ELASTOS_PUSH_SCHEDULER_H__
@@ -0,0 +1,94 @@
+
+#include "RateLimiter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace elastos {
+
+RateLimiter::RateLimiter()
+    : mLastSweep(Clock::now())
+{
+    SetBudget(RequestClass::Owner, 0, 0);
+    SetBudget(RequestClass::Read, RATE_READ_PER_SECOND, RATE_READ_BURST);
+    SetBudget(RequestClass::Control, RATE_CONTROL_PER_SECOND, RATE_CONTROL_BURST);
+}
+
+void RateLimiter::SetBudget(RequestClass requestClass, double perSecond, double burst)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Budget& budget = mBudgets[static_cast<int>(requestClass)];
+    budget.mPerSecond = perSecond;
+    budget.mBurst = std::max(burst, 1.0);
+}
+
+bool RateLimiter::Admit(const std::string& humanCode, RequestClass requestClass, long* retryAfter)
+{
+    int index = static_cast<int>(requestClass);
+    Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    const Budget& budget = mBudgets[index];
+    if (budget.mPerSecond <= 0) {
+        return true;
+    }
+
+    if (now - mLastSweep >= std::chrono::seconds(RATE_SWEEP_INTERVAL)) {
+        Sweep(now);
+    }
+
+    auto it = mSenders.find(humanCode);
+    if (it == mSenders.end()) {
+        // new senders start with a full bucket in every class
+        Sender sender;
+        for (int i = 0; i < static_cast<int>(RequestClass::Count); i++) {
+            sender.mBuckets[i].mTokens = mBudgets[i].mBurst;
+            sender.mBuckets[i].mLast = now;
+            sender.mBuckets[i].mNotified = false;
+        }
+        it = mSenders.emplace(humanCode, sender).first;
+    }
+
+    Bucket& bucket = it->second.mBuckets[index];
+    double elapsed = std::chrono::duration<double>(now - bucket.mLast).count();
+    bucket.mTokens = std::min(budget.mBurst, bucket.mTokens + elapsed * budget.mPerSecond);
+    bucket.mLast = now;
+
+    if (bucket.mTokens >= 1) {
+        bucket.mTokens -= 1;
+        bucket.mNotified = false;
+        return true;
+    }
+
+    *retryAfter = 0;
+    if (!bucket.mNotified) {
+        bucket.mNotified = true;
+        *retryAfter = std::max(1L, static_cast<long>(std::ceil((1 - bucket.mTokens) * 1000 / budget.mPerSecond)));
+    }
+
+    return false;
+}
+
+void RateLimiter::Sweep(Clock::time_point now)
+{
+    mLastSweep = now;
+    for (auto it = mSenders.begin(); it != mSenders.end();) {
+        bool full = true;
+        for (int i = 0; full && i < static_cast<int>(RequestClass::Count); i++) {
+            const Budget& budget = mBudgets[i];
+            if (budget.mPerSecond <= 0) continue;
+
+            const Bucket& bucket = it->second.mBuckets[i];
+            double elapsed = std::chrono::duration<double>(now - bucket.mLast).count();
+            full = bucket.mTokens + elapsed * budget.mPerSecond >= budget.mBurst;
+        }
+
+        if (full) {
+            it = mSenders.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+}
+
+}
@@ -0,0 +1,73 @@
+#ifndef __ELASTOS_RATE_LIMITER_H__
+#define __ELASTOS_RATE_LIMITER_H__
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+// default budgets, requests per second and the burst allowed on top
+#define RATE_READ_PER_SECOND        10
+#define RATE_READ_BURST             30
+#define RATE_CONTROL_PER_SECOND     1
+#define RATE_CONTROL_BURST          5
+
+// seconds between sweeps of the senders whose buckets have refilled
+#define RATE_SWEEP_INTERVAL         60
+
+namespace elastos {
+
+enum class RequestClass {
+    Owner = 0,      // owner only, never limited
+    Read,           // getData, getDataList, getDataPage
+    Control,        // per friend settings such as setFormat
+    Count
+};
+
+// Token buckets per sender and request class, refilled continuously. A
+// sender is kept across reconnects until all its buckets are full again,
+// so cycling the connection does not refill them.
+class RateLimiter
+{
+public:
+    RateLimiter();
+    ~RateLimiter() = default;
+
+    // perSecond <= 0 disables the limit for the class
+    void SetBudget(RequestClass requestClass, double perSecond, double burst);
+
+    // false when the sender is over budget. retryAfter then receives the
+    // milliseconds until the next token, or 0 when the sender was already
+    // told since its last admitted request
+    bool Admit(const std::string& humanCode, RequestClass requestClass, long* retryAfter);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Budget {
+        double mPerSecond;
+        double mBurst;
+    };
+
+    struct Bucket {
+        double mTokens;
+        Clock::time_point mLast;
+        bool mNotified;
+    };
+
+    struct Sender {
+        Bucket mBuckets[static_cast<int>(RequestClass::Count)];
+    };
+
+    // mMutex held, drops the senders that would start full anyway
+    void Sweep(Clock::time_point now);
+
+    std::mutex mMutex;
+    Budget mBudgets[static_cast<int>(RequestClass::Count)];
+    std::unordered_map<std::string, Sender> mSenders;
+    Clock::time_point mLastSweep;
+};
+
+}
+
+#endif //__ELASTOS_RATE_LIMITER_H__
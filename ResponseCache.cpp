@@ -0,0 +1,123 @@
+
+#include "ResponseCache.h"
+
+namespace elastos {
+
+ResponseCache::ResponseCache(size_t capacity)
+    : mCapacity(capacity)
+    , mGeneration(0)
+{
+}
+
+ResponseCache::Payload ResponseCache::GetData(int id, WireFormat format, uint64_t* generation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    *generation = mGeneration;
+    auto& data = DataMap(format);
+    auto it = data.find(id);
+    if (it == data.end()) {
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+void ResponseCache::PutData(int id, WireFormat format, const Payload& payload, uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (generation != mGeneration) return;
+
+    auto& data = DataMap(format);
+    if (data.size() >= mCapacity) {
+        data.clear();
+    }
+    data[id] = payload;
+}
+
+ResponseCache::Payload ResponseCache::GetPage(const std::string& key, const Builder& build)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    auto it = mPages.find(key);
+    if (it != mPages.end()) {
+        return it->second;
+    }
+
+    auto flight = mFlights.find(key);
+    if (flight != mFlights.end()) {
+        std::shared_future<Payload> result = flight->second->mResult;
+        lock.unlock();
+        return result.get();
+    }
+
+    uint64_t generation = mGeneration;
+    std::promise<Payload> promise;
+    auto result = std::make_shared<Flight>();
+    result->mResult = promise.get_future().share();
+    mFlights[key] = result;
+    lock.unlock();
+
+    Payload payload;
+    try {
+        payload = build();
+    } catch (...) {
+        Finish(key, result, nullptr, generation);
+        promise.set_value(nullptr);
+        throw;
+    }
+
+    Finish(key, result, payload, generation);
+    promise.set_value(payload);
+
+    return payload;
+}
+
+void ResponseCache::InvalidatePages()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGeneration++;
+    mPages.clear();
+    mFlights.clear();
+}
+
+void ResponseCache::InvalidateData(int id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGeneration++;
+    mJsonData.erase(id);
+    mBinaryData.erase(id);
+    mPages.clear();
+    mFlights.clear();
+}
+
+void ResponseCache::InvalidateAll()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mGeneration++;
+    mJsonData.clear();
+    mBinaryData.clear();
+    mPages.clear();
+    mFlights.clear();
+}
+
+void ResponseCache::Finish(const std::string& key, const std::shared_ptr<Flight>& flight,
+                           const Payload& payload, uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mFlights.find(key);
+    if (it != mFlights.end() && it->second == flight) {
+        mFlights.erase(it);
+    }
+    if (payload == nullptr || generation != mGeneration) return;
+
+    if (mPages.size() >= mCapacity) {
+        mPages.clear();
+    }
+    mPages[key] = payload;
+}
+
+std::unordered_map<int, ResponseCache::Payload>& ResponseCache::DataMap(WireFormat format)
+{
+    return format == WireFormat::Binary ? mBinaryData : mJsonData;
+}
+
+}
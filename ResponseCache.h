@@ -0,0 +1,71 @@
+#ifndef __ELASTOS_RESPONSE_CACHE_H__
+#define __ELASTOS_RESPONSE_CACHE_H__
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <unordered_map>
+#include "BinaryFormat.h"
+
+#define RESPONSE_CACHE_SIZE     256
+
+namespace elastos {
+
+// Serialized getData / getDataList responses shared by every requester
+// until the owner publishes, deletes or clears. Moments are kept per wire
+// format, page keys are expected to name the format themselves.
+class ResponseCache
+{
+public:
+    typedef std::shared_ptr<const std::string> Payload;
+
+    ResponseCache(size_t capacity = RESPONSE_CACHE_SIZE);
+    ~ResponseCache() = default;
+
+    // on a miss returns null and the generation to pass to Put, so a
+    // response built before an invalidation is not stored afterwards
+    Payload GetData(int id, WireFormat format, uint64_t* generation);
+    void PutData(int id, WireFormat format, const Payload& payload, uint64_t generation);
+
+    // returns the cached page or builds it. Concurrent callers asking for
+    // the same key share a single build and its payload; a null payload
+    // (build failed) is handed to all of them but not cached
+    typedef std::function<Payload()> Builder;
+    Payload GetPage(const std::string& key, const Builder& build);
+
+    // a new moment changes every page but no single moment
+    void InvalidatePages();
+    void InvalidateData(int id);
+    void InvalidateAll();
+
+private:
+    std::unordered_map<int, Payload>& DataMap(WireFormat format);
+
+    // a page build other callers can wait on
+    struct Flight {
+        std::shared_future<Payload> mResult;
+    };
+
+    // ends the build of key and caches its payload unless invalidated meanwhile
+    void Finish(const std::string& key, const std::shared_ptr<Flight>& flight,
+                const Payload& payload, uint64_t generation);
+
+    size_t mCapacity;
+
+    std::mutex mMutex;
+    uint64_t mGeneration;
+    std::unordered_map<int, Payload> mJsonData;
+    std::unordered_map<int, Payload> mBinaryData;
+    std::unordered_map<std::string, Payload> mPages;
+
+    // pages being built, dropped on invalidation so later callers do not
+    // join a build that may have read the old data
+    std::unordered_map<std::string, std::shared_ptr<Flight>> mFlights;
+};
+
+}
+
+#endif //__ELASTOS_RESPONSE_CACHE_H__
@@ -0,0 +1,69 @@
+
+#include "ResultWriter.h"
+
+namespace elastos {
+
+void JsonResultWriter::BeginList()
+{
+    mWriter.BeginArray();
+}
+
+void JsonResultWriter::EndList()
+{
+    mWriter.EndArray();
+}
+
+void JsonResultWriter::WriteEntry(int id, long time)
+{
+    mWriter.BeginObject();
+    mWriter.Key("id").Int(id);
+    mWriter.Key("time").Int(time);
+    mWriter.EndObject();
+}
+
+void JsonResultWriter::WriteMoment(const DatabaseHelper::MomentView& moment)
+{
+    mWriter.BeginObject();
+    mWriter.Key("id").Int(moment.mId);
+    mWriter.Key("type").Int(moment.mType);
+    mWriter.Key("content").String(moment.mContent, moment.mContentLength);
+    mWriter.Key("time").Int(moment.mTime);
+    mWriter.Key("files").String(moment.mFiles, moment.mFilesLength);
+    mWriter.Key("access").String(moment.mAccess, moment.mAccessLength);
+    mWriter.EndObject();
+}
+
+void BinaryResultWriter::BeginList()
+{
+    mLastId = 0;
+    mLastTime = 0;
+}
+
+void BinaryResultWriter::EndList()
+{
+    mWriter.Byte(0);
+}
+
+void BinaryResultWriter::WriteEntry(int id, long time)
+{
+    mWriter.Byte(1);
+    mWriter.SignedVarint(id - mLastId);
+    mWriter.SignedVarint(time - mLastTime);
+    mLastId = id;
+    mLastTime = time;
+}
+
+void BinaryResultWriter::WriteMoment(const DatabaseHelper::MomentView& moment)
+{
+    mWriter.Byte(2);
+    mWriter.SignedVarint(moment.mId - mLastId);
+    mWriter.Varint(moment.mType);
+    mWriter.SignedVarint(moment.mTime - mLastTime);
+    mWriter.Bytes(moment.mContent, moment.mContentLength);
+    mWriter.Bytes(moment.mFiles, moment.mFilesLength);
+    mWriter.Bytes(moment.mAccess, moment.mAccessLength);
+    mLastId = moment.mId;
+    mLastTime = moment.mTime;
+}
+
+}
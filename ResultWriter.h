@@ -0,0 +1,50 @@
+#ifndef __ELASTOS_RESULT_WRITER_H__
+#define __ELASTOS_RESULT_WRITER_H__
+
+#include "DatabaseHelper.h"
+#include "JsonWriter.h"
+#include "BinaryFormat.h"
+
+namespace elastos {
+
+// lists as json arrays, entries as {"id","time"} and moments as objects
+class JsonResultWriter : public DatabaseHelper::ResultWriter
+{
+public:
+    JsonResultWriter(JsonWriter& writer)
+        : mWriter(writer)
+    {}
+
+    virtual void BeginList() override;
+    virtual void EndList() override;
+    virtual void WriteEntry(int id, long time) override;
+    virtual void WriteMoment(const DatabaseHelper::MomentView& moment) override;
+
+private:
+    JsonWriter& mWriter;
+};
+
+// lists and items as described in BinaryFormat.h
+class BinaryResultWriter : public DatabaseHelper::ResultWriter
+{
+public:
+    BinaryResultWriter(BinaryWriter& writer)
+        : mWriter(writer)
+        , mLastId(0)
+        , mLastTime(0)
+    {}
+
+    virtual void BeginList() override;
+    virtual void EndList() override;
+    virtual void WriteEntry(int id, long time) override;
+    virtual void WriteMoment(const DatabaseHelper::MomentView& moment) override;
+
+private:
+    BinaryWriter& mWriter;
+    int64_t mLastId;
+    int64_t mLastTime;
+};
+
+}
+
+#endif //__ELASTOS_RESULT_WRITER_H__
@@ -0,0 +1,38 @@
+
+#include "ServiceHost.h"
+#include "Log.h"
+
+namespace elastos {
+
+std::mutex ServiceHost::sMutex;
+std::weak_ptr<ServiceHost> ServiceHost::sHost;
+
+std::shared_ptr<ServiceHost> ServiceHost::Acquire()
+{
+    std::lock_guard<std::mutex> lock(sMutex);
+    auto host = sHost.lock();
+    if (host.get() == nullptr) {
+        host = std::make_shared<ServiceHost>();
+        sHost = host;
+    }
+
+    return host;
+}
+
+ServiceHost::ServiceHost()
+    : mWorkerPool(std::make_shared<WorkerPool>(HOST_WORKER_THREADS, HOST_WORKER_QUEUE_MAX))
+{
+    LOGI(LOG_SERVICE, "ServiceHost start");
+    mWorkerPool->Start();
+    mScheduler.Start();
+}
+
+ServiceHost::~ServiceHost()
+{
+    // the tenants are gone, nothing queued belongs to anyone anymore
+    mScheduler.Stop();
+    mWorkerPool->Stop();
+    LOGI(LOG_SERVICE, "ServiceHost stop");
+}
+
+}
@@ -0,0 +1,45 @@
+#ifndef __ELASTOS_SERVICE_HOST_H__
+#define __ELASTOS_SERVICE_HOST_H__
+
+#include <memory>
+#include <mutex>
+#include "WorkerPool.h"
+#include "PushScheduler.h"
+#include "DatabaseCache.h"
+
+// a host serves every tenant of the process, so it gets more workers and
+// deeper queues than a single service used to
+#define HOST_WORKER_THREADS     8
+#define HOST_WORKER_QUEUE_MAX   1024
+
+namespace elastos {
+
+// Runtime shared by all MomentsService tenants of a process: the workers
+// running requests, pushes and sends, the push timer thread and the cache
+// of open databases. A tenant costs no thread of its own.
+class ServiceHost
+{
+public:
+    // the host of the process, created with the first tenant and stopped
+    // when the last one releases it
+    static std::shared_ptr<ServiceHost> Acquire();
+
+    ServiceHost();
+    ~ServiceHost();
+
+    const std::shared_ptr<WorkerPool>& GetWorkerPool() { return mWorkerPool; }
+    PushScheduler& GetScheduler() { return mScheduler; }
+    DatabaseCache& GetDatabases() { return mDatabases; }
+
+private:
+    static std::mutex sMutex;
+    static std::weak_ptr<ServiceHost> sHost;
+
+    std::shared_ptr<WorkerPool> mWorkerPool;
+    PushScheduler mScheduler;
+    DatabaseCache mDatabases;
+};
+
+}
+
+#endif //__ELASTOS_SERVICE_HOST_H__
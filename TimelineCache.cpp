@@ -0,0 +1,177 @@
+
+#include "TimelineCache.h"
+#include <algorithm>
+#include <limits>
+
+namespace elastos {
+
+TimelineCache::TimelineCache(size_t capacity)
+    : mCapacity(capacity)
+    , mComplete(false)
+{
+}
+
+DatabaseHelper::Cursor TimelineCache::KeyOf(const MomentPtr& moment)
+{
+    return DatabaseHelper::Cursor(moment->GetTime(), moment->GetId());
+}
+
+bool TimelineCache::Covers(const DatabaseHelper::Cursor& cursor)
+{
+    if (mComplete) return true;
+    if (mMoments.empty()) return false;
+
+    return !(cursor < KeyOf(mMoments.back()));
+}
+
+void TimelineCache::Reset(std::vector<MomentPtr>& moments, bool complete)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMoments.swap(moments);
+    mComplete = complete;
+    if (mMoments.size() > mCapacity) {
+        mMoments.resize(mCapacity);
+        mComplete = false;
+    }
+}
+
+void TimelineCache::Insert(const MomentPtr& moment)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    DatabaseHelper::Cursor key = KeyOf(moment);
+    if (!Covers(key)) {
+        // older than everything cached, the database still has it
+        return;
+    }
+
+    auto it = std::find_if(mMoments.begin(), mMoments.end(), [&key](const MomentPtr& item) {
+        return KeyOf(item) < key;
+    });
+    mMoments.insert(it, moment);
+
+    if (mMoments.size() > mCapacity) {
+        mMoments.pop_back();
+        mComplete = false;
+    }
+}
+
+void TimelineCache::Remove(int id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = std::find_if(mMoments.begin(), mMoments.end(), [id](const MomentPtr& item) {
+        return item->GetId() == id;
+    });
+    if (it != mMoments.end()) {
+        mMoments.erase(it);
+    }
+}
+
+void TimelineCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMoments.clear();
+    mComplete = true;
+}
+
+bool TimelineCache::Find(int id, MomentPtr& moment)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& item : mMoments) {
+        if (item->GetId() == id) {
+            moment = item;
+            return true;
+        }
+    }
+
+    moment.reset();
+    return mComplete;
+}
+
+bool TimelineCache::GetList(long time, int limit, std::vector<MomentPtr>& moments)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    moments.clear();
+    for (const auto& item : mMoments) {
+        if ((int)moments.size() == limit || (time > 0 && item->GetTime() <= time)) break;
+        moments.push_back(item);
+    }
+
+    if ((int)moments.size() == limit) return true;
+
+    bool covered = time <= 0 ? mComplete
+                             : Covers(DatabaseHelper::Cursor(time, std::numeric_limits<int>::max()));
+    if (!covered) {
+        moments.clear();
+    }
+    return covered;
+}
+
+bool TimelineCache::GetDelta(const DatabaseHelper::Cursor& cursor, int limit,
+                             std::vector<MomentPtr>& moments, bool* more)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    moments.clear();
+    bool fromStart = cursor.mTime <= 0 && cursor.mId <= 0;
+    if (fromStart ? !mComplete : !Covers(cursor)) {
+        return false;
+    }
+
+    // walk from the oldest entry towards the newest
+    for (auto it = mMoments.rbegin(); it != mMoments.rend(); it++) {
+        if (!fromStart && !(cursor < KeyOf(*it))) continue;
+        if ((int)moments.size() == limit) {
+            *more = true;
+            return true;
+        }
+        moments.push_back(*it);
+    }
+
+    *more = false;
+    return true;
+}
+
+bool TimelineCache::GetPage(long time, int id, DatabaseHelper::PageDirection direction, int size,
+                            std::vector<MomentPtr>& moments, bool* more)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    moments.clear();
+    DatabaseHelper::Cursor cursor(time, id);
+
+    if (direction == DatabaseHelper::PageDirection::Newer) {
+        bool fromStart = time <= 0;
+        if (fromStart ? !mComplete : !Covers(cursor)) {
+            return false;
+        }
+
+        *more = false;
+        for (auto it = mMoments.rbegin(); it != mMoments.rend(); it++) {
+            if (!fromStart && !(cursor < KeyOf(*it))) continue;
+            if ((int)moments.size() == size) {
+                *more = true;
+                break;
+            }
+            moments.push_back(*it);
+        }
+        std::reverse(moments.begin(), moments.end());
+        return true;
+    }
+
+    bool fromEnd = time <= 0;
+    for (const auto& item : mMoments) {
+        if (!fromEnd && !(KeyOf(item) < cursor)) continue;
+        if ((int)moments.size() == size) {
+            *more = true;
+            return true;
+        }
+        moments.push_back(item);
+    }
+
+    // ran out of cached entries, only an answer if nothing older exists
+    *more = false;
+    if (!mComplete) {
+        moments.clear();
+    }
+    return mComplete;
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef __ELASTOS_TIMELINE_CACHE_H__
+#define __ELASTOS_TIMELINE_CACHE_H__
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "DatabaseHelper.h"
+
+#define TIMELINE_CACHE_SIZE     128
+
+namespace elastos {
+
+// Newest moments kept in memory, ordered newest first by (time, id).
+// The cache always holds every live moment at or after its oldest entry,
+// so a query is answered from memory when it stays inside that range and
+// reported as a miss otherwise.
+class TimelineCache
+{
+public:
+    typedef std::shared_ptr<DatabaseHelper::Moment> MomentPtr;
+
+    TimelineCache(size_t capacity = TIMELINE_CACHE_SIZE);
+    ~TimelineCache() = default;
+
+    size_t Capacity() { return mCapacity; }
+
+    // moments newest first, complete when they are all the live moments
+    void Reset(std::vector<MomentPtr>& moments, bool complete);
+
+    void Insert(const MomentPtr& moment);
+    void Remove(int id);
+    void Clear();
+
+    // returns false when the cache cannot answer and the database must be used
+    bool Find(int id, MomentPtr& moment);
+
+    bool GetList(long time, int limit, std::vector<MomentPtr>& moments);
+
+    bool GetDelta(const DatabaseHelper::Cursor& cursor, int limit,
+                  std::vector<MomentPtr>& moments, bool* more);
+
+    bool GetPage(long time, int id, DatabaseHelper::PageDirection direction, int size,
+                 std::vector<MomentPtr>& moments, bool* more);
+
+private:
+    static DatabaseHelper::Cursor KeyOf(const MomentPtr& moment);
+
+    // whether every live moment after cursor is cached
+    bool Covers(const DatabaseHelper::Cursor& cursor);
+
+private:
+    size_t mCapacity;
+
+    std::mutex mMutex;
+    std::vector<MomentPtr> mMoments;
+    bool mComplete;
+};
+
+}
+
+#endif //__ELASTOS_TIMELINE_CACHE_H__
@@ -0,0 +1,171 @@
+
+#include "WorkerPool.h"
+#include <algorithm>
+
+namespace elastos {
+
+WorkerPool::WorkerPool(size_t threads, size_t queueMax)
+    : mQueueMax(queueMax)
+{
+    for (size_t i = 0; i < std::max<size_t>(threads, 1); i++) {
+        auto worker = std::make_shared<Worker>();
+        worker->mStop = true;
+        mWorkers.push_back(worker);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    Stop();
+}
+
+void WorkerPool::Start()
+{
+    for (auto& worker : mWorkers) {
+        if (worker->mThread.get() != nullptr) continue;
+
+        std::unique_lock<std::mutex> lk(worker->mMutex);
+        worker->mStop = false;
+        lk.unlock();
+
+        worker->mThread = std::make_shared<std::thread>(WorkerPool::ThreadFun, worker.get());
+    }
+}
+
+void WorkerPool::Stop()
+{
+    for (auto& worker : mWorkers) {
+        if (worker->mThread.get() == nullptr) continue;
+
+        std::unique_lock<std::mutex> lk(worker->mMutex);
+        worker->mStop = true;
+        worker->mQueue.clear();
+        lk.unlock();
+        worker->mCv.notify_one();
+
+        worker->mThread->join();
+        worker->mThread.reset();
+    }
+}
+
+bool WorkerPool::Post(const std::string& key, Task task)
+{
+    Worker* worker = mWorkers[mHash(key) % mWorkers.size()].get();
+
+    std::unique_lock<std::mutex> lk(worker->mMutex);
+    if (worker->mStop || worker->mQueue.size() >= mQueueMax) {
+        return false;
+    }
+
+    worker->mQueue.push_back(std::move(task));
+    lk.unlock();
+    worker->mCv.notify_one();
+
+    return true;
+}
+
+size_t WorkerPool::Size()
+{
+    size_t size = 0;
+    for (auto& worker : mWorkers) {
+        std::unique_lock<std::mutex> lk(worker->mMutex);
+        size += worker->mQueue.size();
+    }
+
+    return size;
+}
+
+void WorkerPool::ThreadFun(Worker* worker)
+{
+    while (true) {
+        std::unique_lock<std::mutex> lk(worker->mMutex);
+        worker->mCv.wait(lk, [worker] {
+            return worker->mStop || !worker->mQueue.empty();
+        });
+        if (worker->mStop) break;
+
+        Task task = std::move(worker->mQueue.front());
+        worker->mQueue.pop_front();
+        lk.unlock();
+
+        task();
+    }
+}
+
+TaskGroup::TaskGroup(const std::shared_ptr<WorkerPool>& pool, const std::string& prefix)
+    : mPool(pool)
+    , mPrefix(prefix)
+    , mState(std::make_shared<State>())
+{
+    mState->mOpen = false;
+    mState->mGeneration = 0;
+    mState->mQueued = 0;
+    mState->mRunning = 0;
+}
+
+TaskGroup::~TaskGroup()
+{
+    Close();
+}
+
+void TaskGroup::Open()
+{
+    std::unique_lock<std::mutex> lk(mState->mMutex);
+    mState->mOpen = true;
+}
+
+void TaskGroup::Close()
+{
+    std::unique_lock<std::mutex> lk(mState->mMutex);
+    if (mState->mOpen) {
+        mState->mOpen = false;
+        mState->mGeneration++;
+    }
+    mState->mCv.wait(lk, [this] { return mState->mRunning == 0; });
+}
+
+bool TaskGroup::Post(const std::string& key, WorkerPool::Task task)
+{
+    std::unique_lock<std::mutex> lk(mState->mMutex);
+    if (!mState->mOpen) return false;
+    uint64_t generation = mState->mGeneration;
+    mState->mQueued++;
+    lk.unlock();
+
+    // the task keeps only the state, never the group
+    std::shared_ptr<State> state = mState;
+    bool posted = mPool->Post(mPrefix + key, [state, generation, task] {
+        std::unique_lock<std::mutex> lk(state->mMutex);
+        state->mQueued--;
+        if (!state->mOpen || state->mGeneration != generation) return;
+        state->mRunning++;
+        lk.unlock();
+
+        task();
+
+        lk.lock();
+        state->mRunning--;
+        lk.unlock();
+        state->mCv.notify_all();
+    });
+    if (!posted) {
+        lk.lock();
+        mState->mQueued--;
+    }
+
+    return posted;
+}
+
+size_t TaskGroup::Size()
+{
+    std::unique_lock<std::mutex> lk(mState->mMutex);
+    return mState->mQueued;
+}
+
+size_t TaskGroup::Running()
+{
+    std::unique_lock<std::mutex> lk(mState->mMutex);
+    return mState->mRunning;
+}
+
+}
@@ -0,0 +1,98 @@
+#ifndef __ELASTOS_WORKER_POOL_H__
+#define __ELASTOS_WORKER_POOL_H__
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include <condition_variable>
+
+#define WORKER_THREADS      4
+#define WORKER_QUEUE_MAX    256
+
+namespace elastos {
+
+// Runs inbound requests off the carrier callback thread. Tasks posted
+// with the same key always go to the same worker, so they run in order,
+// while different keys are spread over the workers.
+class WorkerPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    WorkerPool(size_t threads = WORKER_THREADS, size_t queueMax = WORKER_QUEUE_MAX);
+    ~WorkerPool();
+
+    void Start();
+
+    // stops the threads, tasks still queued are dropped
+    void Stop();
+
+    // false when the pool is stopped or the worker for key already has
+    // queueMax tasks waiting
+    bool Post(const std::string& key, Task task);
+
+    size_t Size();
+
+private:
+    struct Worker {
+        std::mutex mMutex;
+        std::condition_variable mCv;
+        std::deque<Task> mQueue;
+        bool mStop;
+        std::shared_ptr<std::thread> mThread;
+    };
+
+    static void ThreadFun(Worker* worker);
+
+private:
+    size_t mQueueMax;
+    std::vector<std::shared_ptr<Worker>> mWorkers;
+    std::hash<std::string> mHash;
+};
+
+// The tasks of one owner on a shared pool, keys are prefixed so owners
+// keep their own per-key order. Close drops the tasks still queued and
+// waits for running ones, after that the owner may go away; it must not
+// be called from one of the group's own tasks.
+class TaskGroup
+{
+public:
+    TaskGroup(const std::shared_ptr<WorkerPool>& pool, const std::string& prefix);
+    ~TaskGroup();
+
+    void Open();
+    void Close();
+
+    // false when the group is closed or the pool is full
+    bool Post(const std::string& key, WorkerPool::Task task);
+
+    // tasks posted and not run yet
+    size_t Size();
+
+    // tasks running now, including the caller when it is one of them
+    size_t Running();
+
+private:
+    struct State {
+        std::mutex mMutex;
+        std::condition_variable mCv;
+        bool mOpen;
+        // bumped by Close, tasks of an older generation are skipped
+        uint64_t mGeneration;
+        size_t mQueued;
+        size_t mRunning;
+    };
+
+    std::shared_ptr<WorkerPool> mPool;
+    std::string mPrefix;
+    std::shared_ptr<State> mState;
+};
+
+}
+
+#endif //__ELASTOS_WORKER_POOL_H__
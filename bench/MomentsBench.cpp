@@ -0,0 +1,367 @@
+
+// Benchmarks for the moments plugin against an in-process fake Connector,
+// built with -DMOMENTS_BUILD_BENCHMARK=ON.
+//
+//   moments-bench [--sizes 1000,10000,100000] [--followers 100]
+//                 [--ops 2000] [--dir /tmp/moments-bench]
+//
+// Every run starts from freshly populated databases with fixed content
+// and a fixed random seed, so numbers are comparable between builds.
+// The query plans of the timeline statements are checked on every size,
+// the exit status is 1 when one of them stops using the index.
+// Sizes up to 1000000 moments are practical, population is a single
+// transaction.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <sstream>
+#include <sqlite3.h>
+#include "Connector.h"
+#include "DatabaseHelper.h"
+#include "ResultWriter.h"
+#include "MomentsService.h"
+#include "ServiceHost.h"
+#include "ghc-filesystem.hpp"
+
+using namespace elastos;
+
+#define BENCH_SEED          20191001
+#define BENCH_TIME_BASE     1000
+#define BENCH_TIME_STEP     10
+#define BENCH_WAIT          std::chrono::seconds(60)
+
+namespace {
+
+struct Options {
+    std::vector<int> mSizes;
+    int mFollowers;
+    int mOps;
+    std::string mDir;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+long MomentTime(int index)
+{
+    return BENCH_TIME_BASE + static_cast<long>(index) * BENCH_TIME_STEP;
+}
+
+void Report(const char* name, int size, int ops, Clock::duration elapsed)
+{
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    printf("%-30s %9d %9d %14.0f %14.0f\n", name, size, ops,
+           ns / std::max(ops, 1), ops / (ns / 1e9));
+}
+
+// creates the schema through DatabaseHelper, then bulk loads size moments
+// in one transaction, far faster than size InsertData calls
+int Populate(const std::string& dir, int size)
+{
+    std::error_code error;
+    ghc::filesystem::remove_all(dir, error);
+    ghc::filesystem::create_directories(dir, error);
+    {
+        DatabaseHelper schema(dir);
+    }
+
+    sqlite3* db;
+    int ret = sqlite3_open((dir + "/moments.db").c_str(), &db);
+    if (ret != SQLITE_OK) {
+        printf("open %s failed %d\n", dir.c_str(), ret);
+        return ret;
+    }
+
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    sqlite3_stmt* pStmt;
+    sqlite3_prepare_v2(db, "INSERT INTO moments_list(type,content,time,files,access,isDelete)"
+                           " VALUES (0,?,?,'','',0);", -1, &pStmt, nullptr);
+    for (int i = 0; i < size; i++) {
+        std::string content = "moment " + std::to_string(i) + std::string(80, 'x');
+        sqlite3_bind_text(pStmt, 1, content.c_str(), content.size(), SQLITE_TRANSIENT);
+        sqlite3_bind_int64(pStmt, 2, MomentTime(i));
+        sqlite3_step(pStmt);
+        sqlite3_reset(pStmt);
+    }
+    sqlite3_finalize(pStmt);
+    ret = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    return ret;
+}
+
+struct PlanCheck {
+    const char* mStatement;
+    const char* mExpected;
+    bool mSortAllowed;
+};
+
+// the timeline statements must seek the (isDelete, time) index, never
+// scan the table, and only the newer page may sort its rows
+const PlanCheck sPlanChecks[] = {
+    { "get_id_delta", "USING COVERING INDEX moments_list_time_index", false },
+    { "has_newer", "USING COVERING INDEX moments_list_time_index", false },
+    { "get_data_list", "USING INDEX moments_list_time_index", false },
+    { "get_page_older", "USING INDEX moments_list_time_index", false },
+    { "get_page_newer", "USING INDEX moments_list_time_index", true },
+    { "get_data", "USING INTEGER PRIMARY KEY", false },
+};
+
+bool CheckPlans(DatabaseHelper& db, int size)
+{
+    bool passed = true;
+    for (const PlanCheck& check : sPlanChecks) {
+        std::vector<std::string> plan;
+        if (db.ExplainStatement(check.mStatement, &plan) != 0) {
+            printf("plan %s: explain failed\n", check.mStatement);
+            passed = false;
+            continue;
+        }
+
+        bool expected = false;
+        bool valid = true;
+        for (const std::string& line : plan) {
+            if (line.find(check.mExpected) != std::string::npos) expected = true;
+            if (line.compare(0, 17, "SCAN moments_list") == 0) valid = false;
+            if (!check.mSortAllowed && line.find("TEMP B-TREE") != std::string::npos) valid = false;
+        }
+        if (!expected || !valid) {
+            printf("plan %s at %d moments, expected %s:\n", check.mStatement, size, check.mExpected);
+            for (const std::string& line : plan) {
+                printf("    %s\n", line.c_str());
+            }
+            passed = false;
+        }
+    }
+
+    return passed;
+}
+
+bool BenchDatabase(const Options& options, int size)
+{
+    std::string dir = options.mDir + "/db-" + std::to_string(size);
+    if (Populate(dir, size) != SQLITE_OK) return false;
+
+    DatabaseHelper db(dir);
+    bool plansPassed = CheckPlans(db, size);
+    std::mt19937 random(BENCH_SEED);
+    std::uniform_int_distribution<int> pick(0, size - 1);
+    JsonWriter json;
+    JsonResultWriter jsonWriter(json);
+    BinaryWriter binary;
+    BinaryResultWriter binaryWriter(binary);
+    int ops = options.mOps;
+
+    auto start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        int count;
+        json.Reset();
+        db.GetData(0, DATA_LIMIT, jsonWriter, &count);
+    }
+    Report("db.get_data_list", size, ops, Clock::now() - start);
+
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        bool found;
+        json.Reset();
+        db.GetData(pick(random) + 1, jsonWriter, &found);
+    }
+    Report("db.get_data_id", size, ops, Clock::now() - start);
+
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        int index = pick(random);
+        bool more;
+        json.Reset();
+        db.GetDataPage(MomentTime(index), index + 1, DatabaseHelper::PageDirection::Older,
+                       DATA_LIMIT, jsonWriter, &more);
+    }
+    Report("db.get_page_older", size, ops, Clock::now() - start);
+
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        int index = pick(random);
+        bool more;
+        json.Reset();
+        db.GetDataPage(MomentTime(index), index + 1, DatabaseHelper::PageDirection::Newer,
+                       DATA_LIMIT, jsonWriter, &more);
+    }
+    Report("db.get_page_newer", size, ops, Clock::now() - start);
+
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        int index = pick(random);
+        bool more;
+        binary.Reset();
+        db.GetDataPage(MomentTime(index), index + 1, DatabaseHelper::PageDirection::Older,
+                       DATA_LIMIT, binaryWriter, &more);
+    }
+    Report("db.get_page_older_binary", size, ops, Clock::now() - start);
+
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        int index = pick(random);
+        DatabaseHelper::Cursor last;
+        bool more;
+        json.Reset();
+        db.GetDelta(DatabaseHelper::Cursor(MomentTime(index), index + 1), DELTA_LIMIT,
+                    jsonWriter, &last, &more);
+    }
+    Report("db.get_delta", size, ops, Clock::now() - start);
+
+    // last, it grows the table
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        db.InsertData(0, "inserted moment", MomentTime(size + i), "", "");
+    }
+    Report("db.insert_data", size, ops, Clock::now() - start);
+
+    return plansPassed;
+}
+
+// keeps at most HOST_WORKER_QUEUE_MAX requests unanswered, more would be
+// dropped by the shared host workers instead of measured
+void Throttle(Connector* connector, uint64_t base, int index)
+{
+    if (index >= HOST_WORKER_QUEUE_MAX) {
+        connector->WaitSent(base + index - HOST_WORKER_QUEUE_MAX + 1, BENCH_WAIT);
+    }
+}
+
+std::string FriendCode(int index)
+{
+    std::stringstream code;
+    code << "friend" << index;
+    return code.str();
+}
+
+void BenchService(const Options& options, int size)
+{
+    std::string dir = options.mDir + "/service-" + std::to_string(size);
+    if (Populate(dir + "/Moments", size) != SQLITE_OK) return;
+
+    // friends start caught up to the newest moment, see GetPushCursor
+    const std::string owner = "iOwnerOfTheBenchmarkMomentsService";
+    const std::string user = "benchmark-service";
+    Connector::SetUserCode(user);
+    Connector::ClearFriends();
+    Connector::AddFriend(owner);
+    for (int i = 0; i < options.mFollowers; i++) {
+        auto friendInfo = Connector::AddFriend(FriendCode(i));
+        friendInfo->setHumanInfo(HumanInfo::Item::Addition, std::to_string(MomentTime(size - 1)));
+    }
+
+    auto service = std::make_shared<MomentsService>(dir);
+    Connector* connector = Connector::Last();
+    service->SetOwner(owner);
+    service->SetPushWindow(0);
+    service->SetRateLimit(RequestClass::Read, 0, 0);
+    service->SetRateLimit(RequestClass::Control, 0, 0);
+    service->SetSenderQueueLimit(0);
+
+    connector->SetStatus(user, HumanInfo::Status::Online);
+    for (int i = 0; i < options.mFollowers; i++) {
+        connector->SetStatus(FriendCode(i), HumanInfo::Status::Online);
+    }
+
+    // one publish fans out a pushData to every follower
+    int rounds = std::max(1, options.mOps / options.mFollowers);
+    uint64_t sent = connector->SentCount();
+    auto start = Clock::now();
+    for (int i = 0; i < rounds; i++) {
+        service->Add(0, "pushed moment", MomentTime(size + i), "", "");
+        sent += options.mFollowers;
+        if (!connector->WaitSent(sent, BENCH_WAIT)) {
+            printf("push round %d timed out\n", i);
+            break;
+        }
+    }
+    Report("service.push_fanout", size, rounds * options.mFollowers, Clock::now() - start);
+
+    // full path from onReceivedMessage to the response, identical requests
+    int ops = options.mOps;
+    sent = connector->SentCount();
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        Throttle(connector, sent, i);
+        connector->Deliver(FriendCode(i % options.mFollowers), "{\"command\":\"getDataList\",\"time\":0}");
+    }
+    if (!connector->WaitSent(sent + ops, BENCH_WAIT)) {
+        printf("getDataList responses timed out\n");
+    }
+    Report("service.dispatch_list", size, ops, Clock::now() - start);
+
+    // distinct cursors, every request misses the response cache
+    std::mt19937 random(BENCH_SEED);
+    std::uniform_int_distribution<int> pick(0, size - 1);
+    sent = connector->SentCount();
+    start = Clock::now();
+    for (int i = 0; i < ops; i++) {
+        Throttle(connector, sent, i);
+        int index = pick(random);
+        std::stringstream message;
+        message << "{\"command\":\"getDataPage\",\"time\":" << MomentTime(index)
+                << ",\"id\":" << index + 1 << ",\"direction\":\"older\"}";
+        connector->Deliver(FriendCode(i % options.mFollowers), message.str());
+    }
+    if (!connector->WaitSent(sent + ops, BENCH_WAIT)) {
+        printf("getDataPage responses timed out\n");
+    }
+    Report("service.dispatch_page", size, ops, Clock::now() - start);
+}
+
+std::vector<int> ParseSizes(const std::string& value)
+{
+    std::vector<int> sizes;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        int size = std::atoi(item.c_str());
+        if (size > 0) sizes.push_back(size);
+    }
+
+    return sizes;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.mSizes = { 1000, 10000, 100000 };
+    options.mFollowers = 100;
+    options.mOps = 2000;
+    options.mDir = "/tmp/moments-bench";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        if (name == "--sizes") {
+            options.mSizes = ParseSizes(argv[i + 1]);
+        }
+        else if (name == "--followers") {
+            options.mFollowers = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (name == "--ops") {
+            options.mOps = std::max(1, std::atoi(argv[i + 1]));
+        }
+        else if (name == "--dir") {
+            options.mDir = argv[i + 1];
+        }
+        else {
+            printf("unknown option %s\n", name.c_str());
+            return 1;
+        }
+    }
+
+    printf("%-30s %9s %9s %14s %14s\n", "benchmark", "moments", "ops", "ns/op", "ops/s");
+    int ret = 0;
+    for (int size : options.mSizes) {
+        if (!BenchDatabase(options, size)) ret = 1;
+        BenchService(options, size);
+    }
+
+    return ret;
+}
@@ -0,0 +1,388 @@
+
+// Synthetic follower traffic replayed against the plugin through the fake
+// Connector, built with -DMOMENTS_BUILD_BENCHMARK=ON.
+//
+//   moments-load [--friends 2000] [--concurrency 64] [--duration 10]
+//                [--moments 1000] [--mix publish=1,getData=40,getDataList=40,getDataPage=10,status=9]
+//                [--limits] [--dir /tmp/moments-load]
+//
+// The service is created through CreateService like PeerNode does. Each
+// simulated friend has at most one request in flight, its latency runs
+// from onReceivedMessage to the response reaching the Connector. Status
+// events take a friend offline and back online and have no response.
+// Without --limits the per-sender rate limits and queue cap are lifted so
+// the numbers show the service and not the admission control.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <sstream>
+#include <condition_variable>
+#include "Connector.h"
+#include "Metrics.h"
+#include "MomentsService.h"
+#include "ghc-filesystem.hpp"
+
+using namespace elastos;
+
+namespace elastos {
+extern "C" {
+void* CreateService(const char* path);
+void DestroyService(void* service);
+}
+}
+
+#define LOAD_SEED           20191001
+#define LOAD_TIMEOUT        std::chrono::seconds(5)
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+enum Operation {
+    OP_PUBLISH = 0,
+    OP_GET_DATA,
+    OP_GET_DATA_LIST,
+    OP_GET_DATA_PAGE,
+    OP_STATUS,
+    OP_COUNT
+};
+
+const char* const sOperationNames[OP_COUNT] = {
+    "publish",
+    "getData",
+    "getDataList",
+    "getDataPage",
+    "status"
+};
+
+struct Options {
+    int mFriends;
+    int mConcurrency;
+    int mDuration;
+    int mMoments;
+    int mMix[OP_COUNT];
+    bool mLimits;
+    std::string mDir;
+};
+
+// requests in flight by sender, completed by the Connector send hook
+class Tracker
+{
+public:
+    Tracker()
+        : mCompleted(0)
+        , mRejected(0)
+        , mLost(0)
+        , mPushes(0)
+    {}
+
+    bool Begin(const std::string& humanCode, Operation operation)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mPending.count(humanCode) > 0) return false;
+
+        Pending pending;
+        pending.mOperation = operation;
+        pending.mStart = Clock::now();
+        mPending[humanCode] = pending;
+
+        return true;
+    }
+
+    void OnSend(const std::string& humanCode, const std::string& message)
+    {
+        std::string command = Command(message);
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (command == "pushData") {
+            mPushes++;
+            return;
+        }
+
+        auto it = mPending.find(humanCode);
+        if (it == mPending.end()) return;
+        if (command != "busy" && command != sOperationNames[it->second.mOperation]) return;
+
+        auto elapsed = Clock::now() - it->second.mStart;
+        mLatency[it->second.mOperation].Record(
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+        if (command == "busy") {
+            mRejected++;
+        }
+        mCompleted++;
+        mPending.erase(it);
+        lock.unlock();
+        mCv.notify_one();
+    }
+
+    // waits until fewer than limit requests are in flight, dropping the
+    // ones that never got an answer
+    void WaitBelow(size_t limit)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (mPending.size() >= limit) {
+            if (!mCv.wait_for(lock, std::chrono::milliseconds(100), [this, limit] {
+                    return mPending.size() < limit;
+                })) {
+                Expire(Clock::now() - LOAD_TIMEOUT);
+            }
+        }
+    }
+
+    void Drain()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mCv.wait_for(lock, LOAD_TIMEOUT, [this] { return mPending.empty(); })) {
+            Expire(Clock::time_point::max());
+        }
+    }
+
+    void Report(double seconds)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        printf("completed %llu requests in %.2fs, %.0f req/s, %llu busy, %llu lost, %llu pushData sent\n",
+               static_cast<unsigned long long>(mCompleted), seconds, mCompleted / seconds,
+               static_cast<unsigned long long>(mRejected), static_cast<unsigned long long>(mLost),
+               static_cast<unsigned long long>(mPushes));
+        printf("%-14s %10s %10s %10s %10s %10s\n", "latency(us)", "count", "p50", "p90", "p99", "max");
+        for (int i = 0; i < OP_COUNT; i++) {
+            if (mLatency[i].Count() == 0) continue;
+            Json json = mLatency[i].ToJson();
+            printf("%-14s %10llu %10llu %10llu %10llu %10llu\n", sOperationNames[i],
+                   json["count"].get<unsigned long long>(), json["p50"].get<unsigned long long>(),
+                   json["p90"].get<unsigned long long>(), json["p99"].get<unsigned long long>(),
+                   json["max"].get<unsigned long long>());
+        }
+    }
+
+private:
+    struct Pending {
+        Operation mOperation;
+        Clock::time_point mStart;
+    };
+
+    static std::string Command(const std::string& message)
+    {
+        static const std::string prefix = "{\"command\":\"";
+        if (message.compare(0, prefix.size(), prefix) != 0) return "";
+
+        size_t end = message.find('"', prefix.size());
+        return end == std::string::npos ? "" : message.substr(prefix.size(), end - prefix.size());
+    }
+
+    // mMutex held
+    void Expire(Clock::time_point before)
+    {
+        for (auto it = mPending.begin(); it != mPending.end();) {
+            if (it->second.mStart < before) {
+                mLost++;
+                it = mPending.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::map<std::string, Pending> mPending;
+    Histogram mLatency[OP_COUNT];
+    uint64_t mCompleted;
+    uint64_t mRejected;
+    uint64_t mLost;
+    uint64_t mPushes;
+};
+
+std::string FriendCode(int index)
+{
+    std::stringstream code;
+    code << "friend" << index;
+    return code.str();
+}
+
+std::string PublishMessage(long time)
+{
+    std::stringstream message;
+    message << "{\"command\":\"publish\",\"type\":0,\"content\":\"load moment " << time
+            << "\",\"time\":" << time << ",\"access\":\"\"}";
+    return message.str();
+}
+
+bool ParseMix(const std::string& value, int* mix)
+{
+    for (int i = 0; i < OP_COUNT; i++) {
+        mix[i] = 0;
+    }
+
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        size_t equal = item.find('=');
+        if (equal == std::string::npos) return false;
+
+        std::string name = item.substr(0, equal);
+        int i = 0;
+        while (i < OP_COUNT && name != sOperationNames[i]) i++;
+        if (i == OP_COUNT) return false;
+        mix[i] = std::max(0, std::atoi(item.c_str() + equal + 1));
+    }
+
+    return true;
+}
+
+int Run(const Options& options)
+{
+    const std::string owner = "iOwnerOfTheLoadGeneratorMomentsSvc";
+    const std::string user = "load-service";
+    Connector::SetUserCode(user);
+    Connector::ClearFriends();
+    Connector::AddFriend(owner);
+    for (int i = 0; i < options.mFriends; i++) {
+        Connector::AddFriend(FriendCode(i));
+    }
+
+    std::error_code error;
+    ghc::filesystem::remove_all(options.mDir, error);
+    ghc::filesystem::create_directories(options.mDir, error);
+
+    void* handle = CreateService(options.mDir.c_str());
+    MomentsService* service = static_cast<MomentsService*>(handle);
+    Connector* connector = Connector::Last();
+    service->SetOwner(owner);
+    if (!options.mLimits) {
+        service->SetRateLimit(RequestClass::Read, 0, 0);
+        service->SetRateLimit(RequestClass::Control, 0, 0);
+        service->SetSenderQueueLimit(0);
+    }
+
+    Tracker tracker;
+    connector->SetSendHook([&tracker](const std::string& humanCode, const std::string& message) {
+        tracker.OnSend(humanCode, message);
+    });
+
+    connector->SetStatus(user, HumanInfo::Status::Online);
+    for (int i = 0; i < options.mFriends; i++) {
+        connector->SetStatus(FriendCode(i), HumanInfo::Status::Online);
+    }
+
+    // the owner publishes the initial timeline one moment at a time
+    long time = 1000;
+    for (int i = 0; i < options.mMoments; i++) {
+        tracker.WaitBelow(1);
+        tracker.Begin(owner, OP_PUBLISH);
+        connector->Deliver(owner, PublishMessage(time++));
+    }
+    tracker.Drain();
+    Tracker measured;
+    connector->SetSendHook([&measured](const std::string& humanCode, const std::string& message) {
+        measured.OnSend(humanCode, message);
+    });
+
+    std::mt19937 random(LOAD_SEED);
+    std::discrete_distribution<int> pickOperation(options.mMix, options.mMix + OP_COUNT);
+    std::uniform_int_distribution<int> pickFriend(0, options.mFriends - 1);
+    std::uniform_int_distribution<int> pickMoment(0, std::max(options.mMoments - 1, 0));
+
+    auto start = Clock::now();
+    auto end = start + std::chrono::seconds(options.mDuration);
+    while (Clock::now() < end) {
+        measured.WaitBelow(options.mConcurrency);
+
+        Operation operation = static_cast<Operation>(pickOperation(random));
+        std::string humanCode = operation == OP_PUBLISH ? owner : FriendCode(pickFriend(random));
+        if (operation == OP_STATUS) {
+            connector->SetStatus(humanCode, HumanInfo::Status::Offline);
+            connector->SetStatus(humanCode, HumanInfo::Status::Online);
+            continue;
+        }
+        if (!measured.Begin(humanCode, operation)) continue;
+
+        int index = pickMoment(random);
+        std::stringstream message;
+        switch (operation) {
+        case OP_PUBLISH:
+            message << PublishMessage(time++);
+            break;
+        case OP_GET_DATA:
+            message << "{\"command\":\"getData\",\"id\":" << index + 1 << "}";
+            break;
+        case OP_GET_DATA_LIST:
+            message << "{\"command\":\"getDataList\",\"time\":0}";
+            break;
+        default:
+            message << "{\"command\":\"getDataPage\",\"time\":" << 1000 + index
+                    << ",\"id\":" << index + 1 << ",\"direction\":\"older\"}";
+            break;
+        }
+        connector->Deliver(humanCode, message.str());
+    }
+    measured.Drain();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    measured.Report(seconds);
+
+    DestroyService(handle);
+
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.mFriends = 2000;
+    options.mConcurrency = 64;
+    options.mDuration = 10;
+    options.mMoments = 1000;
+    options.mLimits = false;
+    options.mDir = "/tmp/moments-load";
+    ParseMix("publish=1,getData=40,getDataList=40,getDataPage=10,status=9", options.mMix);
+
+    for (int i = 1; i < argc; i++) {
+        std::string name = argv[i];
+        if (name == "--limits") {
+            options.mLimits = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printf("missing value for %s\n", name.c_str());
+            return 1;
+        }
+
+        std::string value = argv[++i];
+        if (name == "--friends") {
+            options.mFriends = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (name == "--concurrency") {
+            options.mConcurrency = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (name == "--duration") {
+            options.mDuration = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (name == "--moments") {
+            options.mMoments = std::max(1, std::atoi(value.c_str()));
+        }
+        else if (name == "--mix") {
+            if (!ParseMix(value, options.mMix)) {
+                printf("invalid mix %s\n", value.c_str());
+                return 1;
+            }
+        }
+        else if (name == "--dir") {
+            options.mDir = value;
+        }
+        else {
+            printf("unknown option %s\n", name.c_str());
+            return 1;
+        }
+    }
+
+    return Run(options);
+}
@@ -0,0 +1,215 @@
+#ifndef __ELASTOS_FAKE_CONNECTOR_H__
+#define __ELASTOS_FAKE_CONNECTOR_H__
+
+// In-process Connector for the benchmark: messages sent by the plugin are
+// counted instead of going to the carrier, and the benchmark injects
+// friend events and inbound messages through the registered listener.
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include "PeerListener.h"
+
+namespace elastos {
+
+class ErrCode
+{
+public:
+    static const int StdSystemErrorIndex = -1000;
+
+    static std::string ToString(int errCode)
+    {
+        return "error " + std::to_string(errCode);
+    }
+};
+
+class Connector
+{
+public:
+    // called for every SendMessage, on the sending thread
+    typedef std::function<void(const std::string& humanCode, const std::string& message)> SendHook;
+
+    Connector(const std::string& serviceName)
+        : mServiceName(serviceName)
+        , mSent(0)
+        , mSentBytes(0)
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        World().mLast = this;
+    }
+
+    ~Connector()
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        if (World().mLast == this) {
+            World().mLast = nullptr;
+        }
+    }
+
+    // user and friends seen by connectors created afterwards
+    static void SetUserCode(const std::string& humanCode)
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        World().mUserCode = humanCode;
+    }
+
+    static std::shared_ptr<FriendInfo> AddFriend(const std::string& humanCode)
+    {
+        auto friendInfo = std::make_shared<FriendInfo>(humanCode);
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        World().mFriends.push_back(friendInfo);
+        return friendInfo;
+    }
+
+    static void ClearFriends()
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        World().mFriends.clear();
+    }
+
+    // the connector created last, the one owned by the service under test
+    static Connector* Last()
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        return World().mLast;
+    }
+
+    // plugin side
+
+    void SetMessageListener(std::shared_ptr<PeerListener::MessageListener>& listener)
+    {
+        mListener = listener;
+    }
+
+    std::shared_ptr<ElaphantContact::UserInfo> GetUserInfo()
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        return std::make_shared<ElaphantContact::UserInfo>(World().mUserCode);
+    }
+
+    std::vector<std::shared_ptr<ElaphantContact::FriendInfo>> ListFriendInfo()
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        return World().mFriends;
+    }
+
+    int GetFriendInfo(const std::string& humanCode, std::shared_ptr<ElaphantContact::FriendInfo>& friendInfo)
+    {
+        std::lock_guard<std::mutex> lock(World().mMutex);
+        for (auto& item : World().mFriends) {
+            std::string code;
+            item->getHumanCode(code);
+            if (code == humanCode) {
+                friendInfo = item;
+                return 0;
+            }
+        }
+
+        friendInfo = std::make_shared<ElaphantContact::FriendInfo>(humanCode);
+        return -1;
+    }
+
+    int SendMessage(const std::string& humanCode, const std::string& message)
+    {
+        if (mSendHook) {
+            mSendHook(humanCode, message);
+        }
+
+        mSentBytes.fetch_add(message.size(), std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mSentMutex);
+            mSent++;
+        }
+        mSentCv.notify_all();
+
+        return 0;
+    }
+
+    // binary frames reach the hook as the same bytes
+    int SendMessage(const std::string& humanCode, const std::vector<uint8_t>& binary)
+    {
+        return SendMessage(humanCode, std::string(binary.begin(), binary.end()));
+    }
+
+    int AcceptFriend(const std::string& humanCode)
+    {
+        AddFriend(humanCode);
+        return 0;
+    }
+
+    // benchmark side
+
+    // set before traffic starts, the hook is not synchronized
+    void SetSendHook(SendHook hook)
+    {
+        mSendHook = std::move(hook);
+    }
+
+    void SetStatus(const std::string& humanCode, HumanInfo::Status status)
+    {
+        ElaphantContact::Listener::StatusEvent event;
+        event.type = ElaphantContact::Listener::EventType::StatusChanged;
+        event.humanCode = humanCode;
+        event.status = status;
+        mListener->onEvent(event);
+    }
+
+    void Deliver(const std::string& humanCode, const std::string& message)
+    {
+        mListener->onReceivedMessage(humanCode, ElaphantContact::Channel::Carrier,
+                                     std::make_shared<ElaphantContact::Message>(message));
+    }
+
+    uint64_t SentCount()
+    {
+        std::lock_guard<std::mutex> lock(mSentMutex);
+        return mSent;
+    }
+
+    uint64_t SentBytes()
+    {
+        return mSentBytes.load(std::memory_order_relaxed);
+    }
+
+    // false when fewer than count messages were sent before the timeout
+    bool WaitSent(uint64_t count, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mSentMutex);
+        return mSentCv.wait_for(lock, timeout, [this, count] {
+            return mSent >= count;
+        });
+    }
+
+private:
+    struct State {
+        std::mutex mMutex;
+        std::string mUserCode;
+        std::vector<std::shared_ptr<FriendInfo>> mFriends;
+        Connector* mLast = nullptr;
+    };
+
+    static State& World()
+    {
+        static State state;
+        return state;
+    }
+
+    std::string mServiceName;
+    std::shared_ptr<PeerListener::MessageListener> mListener;
+    SendHook mSendHook;
+
+    std::mutex mSentMutex;
+    std::condition_variable mSentCv;
+    uint64_t mSent;
+    std::atomic<uint64_t> mSentBytes;
+};
+
+}
+
+#endif //__ELASTOS_FAKE_CONNECTOR_H__
@@ -0,0 +1,9 @@
+#ifndef __ELASTOS_FAKE_JSON_HPP__
+#define __ELASTOS_FAKE_JSON_HPP__
+
+// PeerNode ships nlohmann::json as Json.hpp
+#include <nlohmann/json.hpp>
+
+typedef nlohmann::json Json;
+
+#endif //__ELASTOS_FAKE_JSON_HPP__
@@ -0,0 +1,170 @@
+#ifndef __ELASTOS_FAKE_PEER_LISTENER_H__
+#define __ELASTOS_FAKE_PEER_LISTENER_H__
+
+// In-process stand-ins for the PeerNode / Contact SDK types used by the
+// moments plugin, only as much as the plugin and the benchmark need.
+
+#include <string>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+namespace elastos {
+
+class HumanInfo
+{
+public:
+    enum class Item {
+        Addition
+    };
+
+    enum class Status : uint8_t {
+        Invalid,
+        WaitForAccept,
+        Offline,
+        Online,
+        Removed
+    };
+
+    HumanInfo(const std::string& humanCode = "")
+        : mHumanCode(humanCode)
+    {}
+    virtual ~HumanInfo() = default;
+
+    int getHumanCode(std::string& humanCode) const
+    {
+        humanCode = mHumanCode;
+        return 0;
+    }
+
+    int getHumanInfo(Item item, std::string& value) const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mInfo.find(static_cast<int>(item));
+        value = it != mInfo.end() ? it->second : "";
+        return 0;
+    }
+
+    int setHumanInfo(Item item, const std::string& value)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mInfo[static_cast<int>(item)] = value;
+        return 0;
+    }
+
+private:
+    std::string mHumanCode;
+    mutable std::mutex mMutex;
+    std::map<int, std::string> mInfo;
+};
+
+class FriendInfo : public HumanInfo
+{
+public:
+    FriendInfo(const std::string& humanCode = "")
+        : HumanInfo(humanCode)
+    {}
+};
+
+class UserInfo : public HumanInfo
+{
+public:
+    UserInfo(const std::string& humanCode = "")
+        : HumanInfo(humanCode)
+    {}
+};
+
+}
+
+class ElaphantContact
+{
+public:
+    typedef elastos::HumanInfo HumanInfo;
+    typedef elastos::FriendInfo FriendInfo;
+    typedef elastos::UserInfo UserInfo;
+
+    enum class Channel {
+        Carrier
+    };
+
+    class MsgData
+    {
+    public:
+        MsgData(const std::string& data)
+            : mData(data)
+        {}
+
+        std::string toString() const { return mData; }
+
+    private:
+        std::string mData;
+    };
+
+    class Message
+    {
+    public:
+        Message(const std::string& data)
+            : data(std::make_shared<MsgData>(data))
+        {}
+
+        std::shared_ptr<MsgData> data;
+    };
+
+    class Listener
+    {
+    public:
+        enum class EventType {
+            StatusChanged,
+            FriendRequest,
+            HumanInfoChanged
+        };
+
+        class EventArgs
+        {
+        public:
+            virtual ~EventArgs() = default;
+
+            EventType type;
+            std::string humanCode;
+        };
+
+        class StatusEvent : public EventArgs
+        {
+        public:
+            elastos::HumanInfo::Status status;
+        };
+
+        class RequestEvent : public EventArgs
+        {
+        public:
+            std::string summary;
+        };
+
+        class InfoEvent : public EventArgs
+        {
+        public:
+            std::string toString() { return ""; }
+        };
+    };
+};
+
+namespace elastos {
+
+class PeerListener
+{
+public:
+    class MessageListener
+    {
+    public:
+        virtual ~MessageListener() = default;
+
+        virtual void onEvent(ElaphantContact::Listener::EventArgs& event) = 0;
+        virtual void onReceivedMessage(const std::string& humanCode, ElaphantContact::Channel channelType,
+                                       std::shared_ptr<ElaphantContact::Message> msgInfo) = 0;
+    };
+};
+
+}
+
+#endif //__ELASTOS_FAKE_PEER_LISTENER_H__